@@ -1,269 +1,7809 @@
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <windows.h>
+#include <mmsystem.h>
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef VIDEOPLAYER_HAVE_ALSA
+#include <alsa/asoundlib.h>
+#endif
+#endif
+
 #include <opencv2/opencv.hpp>
+#include <opencv2/core/opengl.hpp>
+#include <opencv2/core/hal/intrin.hpp>
 #include <iostream>
+#include <iomanip>
 #include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <list>
+#include <unordered_map>
+#include <cstdlib>
+#include <cstdio>
+#include <random>
+#include <numeric>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <cstring>
+#include <cerrno>
+#include <map>
+#include <cctype>
+#include <cmath>
+#include <array>
+#include <limits>
+#include <type_traits>
 
-class VideoPlayer {
+/**
+ * Nearest-rank percentile (0-100) of 'samples'; reorders the vector
+ */
+double percentile(std::vector<double>& samples, double p) {
+    if (samples.empty()) {
+        return 0.0;
+    }
+    size_t rank = static_cast<size_t>(p / 100.0 * (samples.size() - 1) + 0.5);
+    std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return samples[rank];
+}
+
+/**
+ * Escape a string for embedding in JSON output
+ */
+std::string jsonEscape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+/**
+ * Write latency samples as a JSON object with count, mean, p50 and p99
+ */
+void writeLatencyJson(std::ostream& out, const char* name, std::vector<double>& samplesMs) {
+    double mean = samplesMs.empty() ? 0.0 : 
+        std::accumulate(samplesMs.begin(), samplesMs.end(), 0.0) / samplesMs.size();
+    out << "  \"" << name << "\": {\"samples\": " << samplesMs.size()
+        << ", \"mean\": " << mean
+        << ", \"p50\": " << percentile(samplesMs, 50)
+        << ", \"p99\": " << percentile(samplesMs, 99) << "}";
+}
+
+/**
+ * Lock-free latency histogram with power-of-two microsecond buckets.
+ * Each instance has a single writer thread; readers may sample it at any time.
+ */
+class LatencyHistogram {
 private:
-    cv::VideoCapture cap;
-    cv::Mat currentFrame;
-    std::string windowName;
-    int totalFrames;
-    int currentFrameNumber;
-    double fps;
+    static constexpr int bucketCount = 32;
+    
+    std::atomic<uint64_t> buckets[bucketCount];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> lastMicros;
     
 public:
-    VideoPlayer() : windowName("Simple Video Player"), 
-                         totalFrames(0), currentFrameNumber(0), fps(30.0) {}
+    LatencyHistogram() {
+        reset();
+    }
+    
+    void record(uint64_t micros) {
+        int bucket = 0;
+        while (bucket < bucketCount - 1 && (micros >> (bucket + 1)) != 0) {
+            bucket++;
+        }
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        lastMicros.store(micros, std::memory_order_relaxed);
+    }
+    
+    void reset() {
+        for (auto& bucket : buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        count.store(0, std::memory_order_relaxed);
+        lastMicros.store(0, std::memory_order_relaxed);
+    }
+    
+    uint64_t samples() const {
+        return count.load(std::memory_order_relaxed);
+    }
     
     /**
-     * Load video file and initialize player
+     * Most recent sample in milliseconds
      */
-    bool loadVideo(const std::string& filename) {
-        cap.open(filename);
+    double lastMs() const {
+        return lastMicros.load(std::memory_order_relaxed) / 1000.0;
+    }
+    
+    /**
+     * Upper bound in milliseconds of the bucket holding the p-th percentile
+     */
+    double percentileMs(double p) const {
+        uint64_t total = samples();
+        if (total == 0) {
+            return 0.0;
+        }
+        uint64_t rank = static_cast<uint64_t>(p / 100.0 * total);
+        uint64_t seen = 0;
+        for (int bucket = 0; bucket < bucketCount; bucket++) {
+            seen += buckets[bucket].load(std::memory_order_relaxed);
+            if (seen > rank) {
+                return (uint64_t(2) << bucket) / 1000.0;
+            }
+        }
+        return (uint64_t(2) << (bucketCount - 1)) / 1000.0;
+    }
+};
+
+/**
+ * Records the lifetime of a scope into a LatencyHistogram
+ */
+class ScopedStageTimer {
+private:
+    LatencyHistogram& histogram;
+    std::chrono::steady_clock::time_point start;
+    
+public:
+    explicit ScopedStageTimer(LatencyHistogram& histogram) 
+        : histogram(histogram), start(std::chrono::steady_clock::now()) {}
+    
+    ~ScopedStageTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        histogram.record(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+    }
+};
+
+/**
+ * Per-stage latencies of the frame pipeline. Decode and convert are only
+ * written by the decode thread, overlay and show only by the UI thread.
+ */
+struct PipelineStats {
+    LatencyHistogram decode;  // cap.grab(): demux + decode
+    LatencyHistogram convert; // cap.retrieve() and FrameFilter: colour conversion / copy out
+    LatencyHistogram overlay; // Frame counter and HUD compose + restore
+    LatencyHistogram show;    // imshow() / texture presentation
+};
+
+/**
+ * Write a stage histogram as a JSON object with count, p50 and p99
+ */
+void writeStageJson(std::ostream& out, const char* name, const LatencyHistogram& histogram) {
+    out << "  \"" << name << "\": {\"samples\": " << histogram.samples()
+        << ", \"p50\": " << histogram.percentileMs(50)
+        << ", \"p99\": " << histogram.percentileMs(99) << "}";
+}
+
+/**
+ * Fixed-size thread pool with one task deque per worker. Workers pop their
+ * own newest task first and steal the oldest task from other workers when
+ * idle, so bursts submitted by one stream spread across all cores.
+ */
+class WorkStealingPool {
+private:
+    struct Worker {
+        std::deque<std::function<void()>> tasks;
+        std::mutex mutex;
+    };
+    
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::atomic<size_t> nextWorker;
+    std::atomic<size_t> pending; // Queued, not yet started tasks
+    bool stopping;
+    std::mutex idleMutex;
+    std::condition_variable idle;
+    
+    static thread_local int currentWorker; // Index of the calling worker, or -1
+    
+    bool popTask(size_t index, std::function<void()>& task) {
+        // Own queue first (newest task, still warm in cache) ...
+        {
+            Worker& own = *workers[index];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                pending--;
+                return true;
+            }
+        }
+        // ... then steal the oldest task of another worker
+        for (size_t offset = 1; offset < workers.size(); offset++) {
+            Worker& victim = *workers[(index + offset) % workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                pending--;
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    void workerLoop(size_t index) {
+        currentWorker = static_cast<int>(index);
+        while (true) {
+            std::function<void()> task;
+            if (popTask(index, task)) {
+                task();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(idleMutex);
+            idle.wait(lock, [this] { return stopping || pending > 0; });
+            if (stopping && pending == 0) {
+                return;
+            }
+        }
+    }
+    
+public:
+    /**
+     * Start 'threadCount' workers; 0 means one per hardware thread
+     */
+    explicit WorkStealingPool(size_t threadCount = 0) 
+        : nextWorker(0), pending(0), stopping(false) {
+        if (threadCount == 0) {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (size_t i = 0; i < threadCount; i++) {
+            workers.push_back(std::make_unique<Worker>());
+        }
+        for (size_t i = 0; i < threadCount; i++) {
+            threads.emplace_back(&WorkStealingPool::workerLoop, this, i);
+        }
+    }
+    
+    /**
+     * Finish all queued tasks, then join the workers
+     */
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(idleMutex);
+            stopping = true;
+        }
+        idle.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+    
+    /**
+     * Queue a task. Tasks submitted from a worker go to that worker's own
+     * deque; others are distributed round-robin.
+     */
+    void submit(std::function<void()> task) {
+        size_t index = currentWorker >= 0 ? static_cast<size_t>(currentWorker) 
+                                           : nextWorker++ % workers.size();
+        {
+            Worker& worker = *workers[index];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(idleMutex);
+            pending++;
+        }
+        idle.notify_one();
+    }
+    
+    size_t size() const {
+        return workers.size();
+    }
+};
+
+thread_local int WorkStealingPool::currentWorker = -1;
+
+/**
+ * cv::MatAllocator that recycles large pixel buffers. Buffers of at least
+ * pooledMinBytes are rounded up to a size class (a power of two or one of
+ * sizeSubSteps - 1 even steps to the next, so at most 25% is wasted)
+ * and kept on a free list per slot size when their last Mat goes away,
+ * so the decoder, the caches and the display path reuse the same few
+ * buffers and steady-state playback does no large heap allocations.
+ * Reference counting stays with cv::Mat (UMatData); buffers are 64-byte
+ * aligned by cv::fastMalloc. Installed process-wide as the default
+ * allocator, so it is never destroyed.
+ */
+class FrameBufferPool : public cv::MatAllocator {
+private:
+    static constexpr size_t pooledMinBytes = 256u << 10;
+    static constexpr size_t sizeSubSteps = 4; // Size classes per power of two
+    static constexpr size_t maxRetainedBytes = 1024u << 20; // Free buffers kept beyond this are released
+    
+    mutable std::mutex mutex;
+    mutable std::unordered_map<size_t, std::vector<uchar*>> freeSlots;
+    mutable size_t retainedBytes;
+    mutable std::atomic<size_t> heapAllocations;
+    mutable std::atomic<size_t> reuses;
+    
+    FrameBufferPool() : retainedBytes(0), heapAllocations(0), reuses(0) {}
+    
+    /**
+     * Size class of a pooled buffer: 'bytes' rounded up to a multiple of a
+     * quarter of the largest power of two not above it. A 640x360 BGR
+     * frame (675 KB) takes 768 KB, not a whole MB.
+     */
+    static size_t slotSize(size_t bytes) {
+        size_t power = pooledMinBytes;
+        while (power <= bytes / 2) {
+            power *= 2;
+        }
+        size_t step = power / sizeSubSteps;
+        return (bytes + step - 1) / step * step;
+    }
+    
+    uchar* acquire(size_t bytes) const {
+        if (bytes >= pooledMinBytes) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = freeSlots.find(slotSize(bytes));
+            if (it != freeSlots.end() && !it->second.empty()) {
+                uchar* data = it->second.back();
+                it->second.pop_back();
+                retainedBytes -= it->first;
+                reuses++;
+                return data;
+            }
+            heapAllocations++;
+            return static_cast<uchar*>(cv::fastMalloc(slotSize(bytes)));
+        }
+        return static_cast<uchar*>(cv::fastMalloc(bytes));
+    }
+    
+    void recycle(uchar* data, size_t bytes) const {
+        if (bytes >= pooledMinBytes) {
+            std::lock_guard<std::mutex> lock(mutex);
+            size_t slot = slotSize(bytes);
+            if (retainedBytes + slot <= maxRetainedBytes) {
+                freeSlots[slot].push_back(data);
+                retainedBytes += slot;
+                return;
+            }
+        }
+        cv::fastFree(data);
+    }
+    
+public:
+    static FrameBufferPool& instance() {
+        static FrameBufferPool* pool = new FrameBufferPool(); // Outlives every Mat
+        return *pool;
+    }
+    
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data0, size_t* step,
+                           cv::AccessFlag, cv::UMatUsageFlags) const override {
+        size_t total = CV_ELEM_SIZE(type);
+        for (int i = dims - 1; i >= 0; i--) {
+            if (step) {
+                if (data0 && step[i] != CV_AUTOSTEP) {
+                    total = step[i];
+                } else {
+                    step[i] = total;
+                }
+            }
+            total *= sizes[i];
+        }
         
-        if (!cap.isOpened()) {
-            std::cerr << "Error: Cannot open video file: " << filename << std::endl;
+        cv::UMatData* u = new cv::UMatData(this);
+        u->data = u->origdata = data0 ? static_cast<uchar*>(data0) : acquire(total);
+        u->size = total;
+        if (data0) {
+            u->flags |= cv::UMatData::USER_ALLOCATED;
+        }
+        return u;
+    }
+    
+    bool allocate(cv::UMatData* u, cv::AccessFlag, cv::UMatUsageFlags) const override {
+        return u != nullptr;
+    }
+    
+    void deallocate(cv::UMatData* u) const override {
+        if (!u) {
+            return;
+        }
+        CV_Assert(u->urefcount == 0 && u->refcount == 0);
+        if (!(u->flags & cv::UMatData::USER_ALLOCATED)) {
+            recycle(u->origdata, u->size);
+        }
+        delete u;
+    }
+    
+    /**
+     * Large buffers taken from the heap so far; flat once playback warmed up
+     */
+    size_t getHeapAllocations() const {
+        return heapAllocations;
+    }
+    
+    size_t getReuses() const {
+        return reuses;
+    }
+    
+    size_t getRetainedBytes() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return retainedBytes;
+    }
+};
+
+/**
+ * Size and modification time of a file, used to validate on-disk caches
+ * derived from it
+ */
+struct FileStamp {
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    
+    static FileStamp of(const std::string& path) {
+        FileStamp stamp;
+        std::error_code error;
+        stamp.size = std::filesystem::file_size(path, error);
+        if (error) {
+            return FileStamp();
+        }
+        stamp.mtime = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+        return stamp;
+    }
+    
+    bool valid() const {
+        return size != 0;
+    }
+    
+    bool operator==(const FileStamp& other) const {
+        return size == other.size && mtime == other.mtime;
+    }
+};
+
+/**
+ * Read-only memory mapping of a whole file
+ */
+class MappedFile {
+private:
+    unsigned char* mappedData;
+    size_t mappedSize;
+#ifdef _WIN32
+    HANDLE fileHandle;
+    HANDLE mappingHandle;
+#endif
+    
+public:
+    MappedFile() : mappedData(nullptr), mappedSize(0) {
+#ifdef _WIN32
+        fileHandle = INVALID_HANDLE_VALUE;
+        mappingHandle = nullptr;
+#endif
+    }
+    
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    ~MappedFile() {
+        close();
+    }
+    
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, 
+                                 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (fileHandle == INVALID_HANDLE_VALUE) {
             return false;
         }
-        
-        // Get video properties
-        totalFrames = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_COUNT));
-        fps = cap.get(cv::CAP_PROP_FPS);
-        currentFrameNumber = 0;
-        
-        // Read first frame
-        if (!cap.read(currentFrame)) {
-            std::cerr << "Error: Cannot read first frame" << std::endl;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+            close();
+            return false;
+        }
+        mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mappingHandle) {
+            close();
+            return false;
+        }
+        mappedData = static_cast<unsigned char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+        mappedSize = static_cast<size_t>(fileSize.QuadPart);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd); // The mapping keeps the file referenced
+        if (data == MAP_FAILED) {
+            return false;
+        }
+        mappedData = static_cast<unsigned char*>(data);
+        mappedSize = static_cast<size_t>(info.st_size);
+#endif
+        if (!mappedData) {
+            close();
             return false;
         }
-        
-        std::cout << "Video loaded successfully:" << std::endl;
-        std::cout << "  Total frames: " << totalFrames << std::endl;
-        std::cout << "  FPS: " << fps << std::endl;
-        std::cout << "  Resolution: " << currentFrame.cols << "x" << currentFrame.rows << std::endl;
-        
         return true;
     }
     
+    void close() {
+#ifdef _WIN32
+        if (mappedData) {
+            UnmapViewOfFile(mappedData);
+        }
+        if (mappingHandle) {
+            CloseHandle(mappingHandle);
+            mappingHandle = nullptr;
+        }
+        if (fileHandle != INVALID_HANDLE_VALUE) {
+            CloseHandle(fileHandle);
+            fileHandle = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (mappedData) {
+            munmap(mappedData, mappedSize);
+        }
+#endif
+        mappedData = nullptr;
+        mappedSize = 0;
+    }
+    
+    const unsigned char* data() const {
+        return mappedData;
+    }
+    
+    size_t size() const {
+        return mappedSize;
+    }
+    
     /**
-     * Move to next frame
+     * Hint that [offset, offset + length) is about to be read so the OS
+     * fetches it asynchronously; a no-op where unsupported
      */
-    bool nextFrame() {
-        if (currentFrameNumber >= totalFrames - 1) {
-            return false; // At end of video
+    void willNeed(uint64_t offset, uint64_t length) const {
+        if (!mappedData || offset >= mappedSize || length == 0) {
+            return;
         }
-        
-        if (cap.read(currentFrame)) {
-            currentFrameNumber++;
-            return true;
+        length = std::min<uint64_t>(length, mappedSize - offset);
+#ifdef _WIN32
+#if _WIN32_WINNT >= 0x0602
+        WIN32_MEMORY_RANGE_ENTRY range = {mappedData + offset, static_cast<SIZE_T>(length)};
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+#else
+        uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        uint64_t start = offset / page * page;
+        madvise(mappedData + start, length + (offset - start), MADV_WILLNEED);
+#endif
+    }
+    
+    /**
+     * Sequential access lets the kernel read ahead aggressively (and drop
+     * pages behind); random access is better while stepping backward
+     */
+    void setSequential(bool sequential) const {
+#ifndef _WIN32
+        if (mappedData) {
+            madvise(mappedData, mappedSize, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
         }
-        return false;
+#else
+        (void)sequential;
+#endif
+    }
+};
+
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 11)
+/**
+ * Feeds a MappedFile to VideoCapture (OpenCV 4.11+ stream input), so the
+ * demuxer copies straight from the mapping instead of issuing small reads.
+ * The mapping must outlive every capture opened on the reader.
+ */
+class MappedStreamReader : public cv::IStreamReader {
+private:
+    const MappedFile& file;
+    long long position;
+    
+public:
+    explicit MappedStreamReader(const MappedFile& file) : file(file), position(0) {}
+    
+    long long read(char* buffer, long long size) override {
+        long long available = static_cast<long long>(file.size()) - position;
+        long long count = std::min(size, available);
+        if (count <= 0) {
+            return 0;
+        }
+        std::memcpy(buffer, file.data() + position, static_cast<size_t>(count));
+        position += count;
+        return count;
+    }
+    
+    long long seek(long long offset, int origin) override {
+        long long target = offset;
+        if (origin == SEEK_CUR) {
+            target += position;
+        } else if (origin == SEEK_END) {
+            target += static_cast<long long>(file.size());
+        }
+        if (target < 0 || target > static_cast<long long>(file.size())) {
+            return -1;
+        }
+        position = target;
+        return position;
     }
     
     /**
-     * Move to previous frame
+     * Bytes consumed so far, including what the demuxer buffered ahead
      */
-    bool previousFrame() {
-        if (currentFrameNumber <= 0) {
-            return false; // At beginning of video
+    long long tell() const {
+        return position;
+    }
+};
+#endif
+
+/**
+ * Decoder selection for loadVideo(); hardware modes fall back to software
+ */
+enum class DecodeBackend {
+    Software,
+    AnyHardware,
+    VAAPI,
+    D3D11,
+    MFX
+};
+
+/**
+ * Real-time exposure filters applied in place: brightness, contrast and
+ * gamma are folded into a single 256-entry LUT applied by cv::LUT. With
+ * grayscale on, the LUT is applied inside the universal-intrinsics luma
+ * pass instead, so each row is read and written once. Applied by the decode thread to the frame it just produced,
+ * so the ring and caches hold filtered frames and no extra buffer is
+ * allocated. Settings only change while the decode thread is stopped and
+ * the prefetch thread is held off (VideoPlayer::changeDecodeOutput()).
+ */
+class FrameFilter {
+private:
+    int brightness;   // Added offset, -100..100
+    double contrast;  // Gain around mid-grey, 0.5..2.0
+    double gamma;     // Display gamma, 0.3..3.0
+    bool grayscale;
+    bool identityLut;
+    cv::Mat lut;      // 1x256 CV_8U, rebuilt when a setting changes
+    cv::UMat grayScratch; // GPU path: reused BGR2GRAY target
+    
+    void rebuildLut() {
+        lut.create(1, 256, CV_8U);
+        uchar* table = lut.ptr<uchar>();
+        identityLut = true;
+        for (int i = 0; i < 256; i++) {
+            double v = std::pow(i / 255.0, 1.0 / gamma) * 255.0;
+            v = (v - 128.0) * contrast + 128.0 + brightness;
+            table[i] = cv::saturate_cast<uchar>(v);
+            identityLut = identityLut && table[i] == i;
         }
-        
-        currentFrameNumber--;
-        cap.set(cv::CAP_PROP_POS_FRAMES, currentFrameNumber);
-        
-        if (cap.read(currentFrame)) {
-            return true;
+    }
+    
+    /**
+     * Look up one BGR row of 'cols' pixels in 'table' (null: identity) and
+     * grayscale it, in place
+     */
+    static void grayRow(uchar* row, int cols, const uchar* table) {
+        // BT.601 luma in 8-bit fixed point: weights sum to 256, so the
+        // 16-bit accumulator cannot overflow
+        int x = 0;
+#if CV_SIMD128
+        const cv::v_uint16x8 wb = cv::v_setall_u16(29);
+        const cv::v_uint16x8 wg = cv::v_setall_u16(150);
+        const cv::v_uint16x8 wr = cv::v_setall_u16(77);
+        const cv::v_uint16x8 half = cv::v_setall_u16(128);
+        uchar mapped[3 * cv::v_uint8x16::nlanes];
+        for (; x <= cols - cv::v_uint8x16::nlanes; x += cv::v_uint8x16::nlanes) {
+            const uchar* pixels = row + 3 * x;
+            if (table) {
+                // No byte gather in the universal intrinsics: look the
+                // block up into a register-sized buffer, then load that
+                for (int i = 0; i < 3 * cv::v_uint8x16::nlanes; i++) {
+                    mapped[i] = table[pixels[i]];
+                }
+                pixels = mapped;
+            }
+            cv::v_uint8x16 b, g, r;
+            cv::v_load_deinterleave(pixels, b, g, r);
+            cv::v_uint16x8 b0, b1, g0, g1, r0, r1;
+            cv::v_expand(b, b0, b1);
+            cv::v_expand(g, g0, g1);
+            cv::v_expand(r, r0, r1);
+            cv::v_uint16x8 y0 = cv::v_add_wrap(cv::v_add_wrap(cv::v_mul_wrap(b0, wb), cv::v_mul_wrap(g0, wg)),
+                                               cv::v_add_wrap(cv::v_mul_wrap(r0, wr), half));
+            cv::v_uint16x8 y1 = cv::v_add_wrap(cv::v_add_wrap(cv::v_mul_wrap(b1, wb), cv::v_mul_wrap(g1, wg)),
+                                               cv::v_add_wrap(cv::v_mul_wrap(r1, wr), half));
+            cv::v_uint8x16 y = cv::v_pack(cv::v_shr<8>(y0), cv::v_shr<8>(y1));
+            cv::v_store_interleave(row + 3 * x, y, y, y);
         }
-        return false;
+#endif
+        for (; x < cols; x++) {
+            uchar* p = row + 3 * x;
+            int b = table ? table[p[0]] : p[0];
+            int g = table ? table[p[1]] : p[1];
+            int r = table ? table[p[2]] : p[2];
+            uchar y = static_cast<uchar>((29 * b + 150 * g + 77 * r + 128) >> 8);
+            p[0] = p[1] = p[2] = y;
+        }
+    }
+    
+public:
+    FrameFilter() : brightness(0), contrast(1.0), gamma(1.0), grayscale(false), identityLut(true) {
+        rebuildLut();
+    }
+    
+    bool active() const {
+        return !identityLut || grayscale;
+    }
+    
+    void adjustBrightness(int delta) {
+        brightness = std::clamp(brightness + delta, -100, 100);
+        rebuildLut();
+    }
+    
+    void adjustContrast(double delta) {
+        contrast = std::clamp(contrast + delta, 0.5, 2.0);
+        rebuildLut();
+    }
+    
+    void adjustGamma(double delta) {
+        gamma = std::clamp(gamma + delta, 0.3, 3.0);
+        rebuildLut();
+    }
+    
+    void toggleGrayscale() {
+        grayscale = !grayscale;
+    }
+    
+    void reset() {
+        brightness = 0;
+        contrast = 1.0;
+        gamma = 1.0;
+        grayscale = false;
+        rebuildLut();
+    }
+    
+    std::string describe() const {
+        char text[96];
+        std::snprintf(text, sizeof(text), "brightness %+d  contrast %.1f  gamma %.1f%s", 
+                      brightness, contrast, gamma, grayscale ? "  grayscale" : "");
+        return text;
     }
     
     /**
-     * Jump to specific frame number
+     * Filter an 8-bit frame in place in one pass: the LUT alone, or the
+     * LUT and grayscale fused per row, rows split across OpenCV's threads
      */
-    bool seekToFrame(int frameNumber) {
-        if (frameNumber < 0 || frameNumber >= totalFrames) {
+    void apply(cv::Mat& frame) const {
+        if (!active() || frame.empty() || frame.depth() != CV_8U) {
+            return;
+        }
+        if (!grayscale || frame.channels() != 3) {
+            if (!identityLut) {
+                cv::LUT(frame, lut, frame); // Vectorised and parallel
+            }
+            return;
+        }
+        const uchar* table = identityLut ? nullptr : lut.ptr<uchar>();
+        cv::parallel_for_(cv::Range(0, frame.rows), [&](const cv::Range& rows) {
+            for (int y = rows.start; y < rows.end; y++) {
+                grayRow(frame.ptr<uchar>(y), frame.cols, table);
+            }
+        });
+    }
+    
+    /**
+     * GPU-resident variant: the same LUT and luma through OpenCL kernels
+     */
+    void apply(cv::UMat& frame) {
+        if (!active() || frame.empty() || frame.depth() != CV_8U) {
+            return;
+        }
+        if (!identityLut) {
+            cv::LUT(frame, lut, frame);
+        }
+        if (grayscale && frame.channels() == 3) {
+            cv::cvtColor(frame, grayScratch, cv::COLOR_BGR2GRAY);
+            cv::cvtColor(grayScratch, frame, cv::COLOR_GRAY2BGR);
+        }
+    }
+};
+
+/**
+ * Pixel layout frames are cached in
+ */
+enum class PixelLayout {
+    BGR,  // As the backend delivers them
+    I420  // Planar 4:2:0: Y, then U, then V
+};
+
+/**
+ * Colour conversion of cached 4:2:0 frames, stored as one CV_8UC1 buffer
+ * of height * 3/2 rows at half the bytes of BGR. Backends hand out BGR,
+ * so frames going into a cache are packed to I420 and unpacked when
+ * presented; the decode-ahead ring stays BGR. Scaling is fused in: luma
+ * and chroma planes are resized to the output size first, so the
+ * conversion itself runs at output resolution. cv::cvtColor's YUV
+ * kernels are vectorised and parallel.
+ */
+class YuvConverter {
+private:
+    PixelLayout layout;
+    cv::Mat scaledPlanar; // Planar frame at the output size
+    
+public:
+    YuvConverter() : layout(PixelLayout::BGR) {}
+    
+    void setLayout(PixelLayout frameLayout) {
+        layout = frameLayout;
+    }
+    
+    PixelLayout getLayout() const {
+        return layout;
+    }
+    
+    /**
+     * True for a frame still in the native layout (converted frames are
+     * CV_8UC3, so caches may hold both kinds)
+     */
+    bool isNative(const cv::Mat& frame) const {
+        return layout != PixelLayout::BGR && frame.type() == CV_8UC1;
+    }
+    
+    /**
+     * True if 'frame' is cached as I420: 8-bit BGR with even dimensions,
+     * with the I420 layout selected
+     */
+    bool packs(const cv::Mat& frame) const {
+        return layout == PixelLayout::I420 && frame.type() == CV_8UC3 && 
+               frame.cols % 2 == 0 && frame.rows % 2 == 0;
+    }
+    
+    /**
+     * Copy 'bgr' into 'cached' in the cache layout
+     */
+    void pack(const cv::Mat& bgr, cv::Mat& cached) const {
+        if (packs(bgr)) {
+            cv::cvtColor(bgr, cached, cv::COLOR_BGR2YUV_I420);
+        } else {
+            bgr.copyTo(cached);
+        }
+    }
+    
+    /**
+     * Picture size of a native frame
+     */
+    static cv::Size pictureSize(const cv::Mat& native) {
+        return cv::Size(native.cols, native.rows * 2 / 3);
+    }
+    
+    const char* describe() const {
+        return layout == PixelLayout::I420 ? "I420" : "BGR";
+    }
+    
+    /**
+     * Convert 'native' to BGR in 'bgr', at 'size' (empty: the native size;
+     * rounded down to even dimensions for the chroma planes)
+     */
+    void toBgr(const cv::Mat& native, cv::Mat& bgr, cv::Size size) {
+        cv::Size picture = pictureSize(native);
+        if (size.empty() || size == picture) {
+            cv::cvtColor(native, bgr, cv::COLOR_YUV2BGR_I420);
+            return;
+        }
+        
+        cv::Size out(size.width & ~1, size.height & ~1);
+        cv::Size chroma(picture.width / 2, picture.height / 2);
+        cv::Size chromaOut(out.width / 2, out.height / 2);
+        const uchar* chromaData = native.ptr(picture.height);
+        cv::Mat luma = native.rowRange(0, picture.height);
+        
+        // Both chroma planes are packed rows of chroma.width bytes after Y;
+        // scale each into its place in the output frame
+        scaledPlanar.create(out.height * 3 / 2, out.width, CV_8UC1);
+        uchar* chromaOutData = scaledPlanar.ptr(out.height);
+        cv::Mat lumaOut = scaledPlanar.rowRange(0, out.height);
+        cv::Mat firstOut(chromaOut, CV_8UC1, chromaOutData);
+        cv::Mat secondOut(chromaOut, CV_8UC1, chromaOutData + chromaOut.area());
+        cv::resize(luma, lumaOut, out, 0, 0, cv::INTER_AREA);
+        cv::resize(cv::Mat(chroma, CV_8UC1, const_cast<uchar*>(chromaData)), 
+                   firstOut, chromaOut, 0, 0, cv::INTER_AREA);
+        cv::resize(cv::Mat(chroma, CV_8UC1, const_cast<uchar*>(chromaData) + chroma.area()), 
+                   secondOut, chromaOut, 0, 0, cv::INTER_AREA);
+        cv::cvtColor(scaledPlanar, bgr, cv::COLOR_YUV2BGR_I420);
+    }
+};
+
+/**
+ * Transfer curve a high-bit-depth source is tone mapped with
+ */
+enum class ToneCurve {
+    Linear, // Rescale the significant bits to 8
+    PQ      // SMPTE ST 2084 (HDR10): rolled off around reference white
+};
+
+/**
+ * Tone mapping of high-bit-depth frames (10, 12 or 16-bit samples in
+ * 16-bit containers) to the 8-bit BGR the filter, overlay and display
+ * code draws on. One kernel is instantiated per sample type and channel
+ * count and picked once per frame from the Mat type; inside it, each
+ * sample is a clamped table lookup with no per-pixel branching. The
+ * table spans the bits the source actually uses, so 10-bit content in a
+ * 16-bit container is not crushed into the bottom of the range. Players
+ * fix that depth once per stream (streamBits()) and hand it to every
+ * mapper working on the stream; an unfixed mapper widens its table from
+ * the largest sample seen so far.
+ */
+class ToneMapper {
+private:
+    ToneCurve curve;
+    int significantBits;    // 10 until a frame needs more, unless fixed
+    bool fixedBits;
+    std::vector<uchar> lut; // 1 << significantBits entries
+    cv::Mat converted;      // Fallback path for depths without a kernel
+    
+    /**
+     * Map 'src' into 8-bit BGR 'dst' and return the largest sample seen;
+     * grey frames are replicated and alpha is dropped
+     */
+    template <typename SampleT, int Channels>
+    struct Kernel {
+        static_assert(std::is_integral<SampleT>::value && std::is_unsigned<SampleT>::value, 
+                      "samples must be unsigned integers");
+        static_assert(Channels == 1 || Channels == 3 || Channels == 4, "grey, BGR or BGRA");
+        
+        static int run(const cv::Mat& src, cv::Mat& dst, const uchar* table, int maxIndex) {
+            std::atomic<int> peak(0);
+            cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range& rows) {
+                int rowsPeak = 0;
+                for (int y = rows.start; y < rows.end; y++) {
+                    const SampleT* in = src.ptr<SampleT>(y);
+                    uchar* out = dst.ptr<uchar>(y);
+                    for (int x = 0; x < src.cols; x++, in += Channels, out += 3) {
+                        if constexpr (Channels == 1) {
+                            int v = in[0];
+                            rowsPeak = std::max(rowsPeak, v);
+                            out[0] = out[1] = out[2] = table[std::min(v, maxIndex)];
+                        } else {
+                            for (int c = 0; c < 3; c++) {
+                                int v = in[c];
+                                rowsPeak = std::max(rowsPeak, v);
+                                out[c] = table[std::min(v, maxIndex)];
+                            }
+                        }
+                    }
+                }
+                int seen = peak.load();
+                while (rowsPeak > seen && !peak.compare_exchange_weak(seen, rowsPeak)) {
+                }
+            });
+            return peak.load();
+        }
+    };
+    
+    using KernelFn = int (*)(const cv::Mat&, cv::Mat&, const uchar*, int);
+    
+    static KernelFn kernelFor(int type) {
+        switch (type) {
+            case CV_16UC1: return &Kernel<uint16_t, 1>::run;
+            case CV_16UC3: return &Kernel<uint16_t, 3>::run;
+            case CV_16UC4: return &Kernel<uint16_t, 4>::run;
+            default:       return nullptr;
+        }
+    }
+    
+    /**
+     * ST 2084 EOTF: normalised code value to absolute luminance in nits
+     */
+    static double pqToNits(double code) {
+        const double m1 = 2610.0 / 16384.0;
+        const double m2 = 2523.0 / 4096.0 * 128.0;
+        const double c1 = 3424.0 / 4096.0;
+        const double c2 = 2413.0 / 4096.0 * 32.0;
+        const double c3 = 2392.0 / 4096.0 * 32.0;
+        double p = std::pow(code, 1.0 / m2);
+        return 10000.0 * std::pow(std::max(p - c1, 0.0) / (c2 - c3 * p), 1.0 / m1);
+    }
+    
+    void rebuildLut() {
+        const double referenceWhite = 203.0; // BT.2408 graphics white, in nits
+        const double peakWhite = 1000.0 / referenceWhite;
+        lut.resize(static_cast<size_t>(1) << significantBits);
+        double maxCode = static_cast<double>(lut.size() - 1);
+        for (size_t i = 0; i < lut.size(); i++) {
+            double v = i / maxCode;
+            if (curve == ToneCurve::PQ) {
+                // Extended Reinhard, reaching 1 at a 1000 nit highlight,
+                // then display gamma
+                double l = pqToNits(v) / referenceWhite;
+                v = std::pow(std::min(l * (1.0 + l / (peakWhite * peakWhite)) / (1.0 + l), 1.0), 1.0 / 2.2);
+            }
+            lut[i] = cv::saturate_cast<uchar>(v * 255.0);
+        }
+    }
+    
+    /**
+     * Bits needed for samples up to 'peak': 10, 12, 14 or 16
+     */
+    static int bitsFor(int peak) {
+        int bits = 10;
+        while (bits < 16 && peak >= (1 << bits)) {
+            bits += 2;
+        }
+        return bits;
+    }
+    
+public:
+    ToneMapper() : curve(ToneCurve::Linear), significantBits(10), fixedBits(false) {
+        rebuildLut();
+    }
+    
+    /**
+     * Mapper for a stream whose depth is already known
+     */
+    ToneMapper(ToneCurve toneCurve, int bits) : curve(toneCurve), significantBits(bits), fixedBits(true) {
+        rebuildLut();
+    }
+    
+    /**
+     * Significant bits of a stream, from its CAP_PROP_CODEC_PIXEL_FORMAT
+     * (FFmpeg's raw tags carry the depth in their last byte) and its
+     * first frame, whichever is more: backends may deliver samples scaled
+     * to the full container range
+     */
+    static int streamBits(int pixelFormat, const cv::Mat& firstFrame) {
+        int formatBits = 0;
+        if ((pixelFormat & 0xFF) == 'Y') {
+            formatBits = (pixelFormat >> 24) & 0xFF;
+        } else if (pixelFormat == cv::VideoWriter::fourcc('P', '0', '1', '0') || 
+                   pixelFormat == cv::VideoWriter::fourcc('P', '0', '1', '6')) {
+            formatBits = 16; // Samples in the high bits
+        }
+        formatBits = formatBits > 8 && formatBits <= 16 ? bitsFor((1 << formatBits) - 1) : 0;
+        
+        double peak = 0.0;
+        if (firstFrame.depth() == CV_16U) {
+            cv::minMaxLoc(firstFrame.reshape(1), nullptr, &peak);
+        }
+        return std::max(formatBits, bitsFor(static_cast<int>(peak)));
+    }
+    
+    /**
+     * Fix the table to 'bits' significant bits; larger samples clamp
+     */
+    void setSignificantBits(int bits) {
+        significantBits = std::clamp(bits, 8, 16);
+        fixedBits = true;
+        rebuildLut();
+    }
+    
+    void setCurve(ToneCurve toneCurve) {
+        curve = toneCurve;
+        rebuildLut();
+    }
+    
+    ToneCurve getCurve() const {
+        return curve;
+    }
+    
+    static bool needsMapping(const cv::Mat& frame) {
+        return !frame.empty() && frame.depth() != CV_8U;
+    }
+    
+    /**
+     * Map a high-bit-depth 'src' to 8-bit BGR in 'dst' (not 'src');
+     * false, with 'dst' untouched, for 8-bit frames
+     */
+    bool apply(const cv::Mat& src, cv::Mat& dst) {
+        if (!needsMapping(src)) {
+            return false;
+        }
+        KernelFn kernel = kernelFor(src.type());
+        if (!kernel) {
+            // Float or signed samples: taken as normalised, generic path
+            double scale = src.depth() == CV_32F || src.depth() == CV_64F ? 255.0 : 1.0;
+            src.convertTo(converted, CV_8U, scale);
+            if (converted.channels() == 3) {
+                cv::swap(converted, dst);
+            } else {
+                cv::cvtColor(converted, dst, converted.channels() == 1 ? cv::COLOR_GRAY2BGR : cv::COLOR_BGRA2BGR);
+            }
+            return true;
+        }
+        
+        dst.create(src.size(), CV_8UC3);
+        int peak = kernel(src, dst, lut.data(), static_cast<int>(lut.size()) - 1);
+        if (!fixedBits && peak >= (1 << significantBits)) {
+            // The source uses more bits than the table covers: widen it
+            // and map this frame again
+            significantBits = bitsFor(peak);
+            rebuildLut();
+            kernel(src, dst, lut.data(), static_cast<int>(lut.size()) - 1);
+        }
+        return true;
+    }
+    
+    int getSignificantBits() const {
+        return significantBits;
+    }
+    
+    const char* describe() const {
+        return curve == ToneCurve::PQ ? "PQ" : "linear";
+    }
+};
+
+/**
+ * Full-reference quality metrics of a distorted frame against its
+ * reference, for encoder QA. PSNR is over all BGR samples. SSIM is over
+ * luma, on 8x8 windows at a stride of 4 built from 4x4 block sums, the
+ * way x264 reports it. The sums are computed with OpenCV's universal
+ * intrinsics where available; each call runs on the calling thread, so
+ * callers parallelise across frames.
+ */
+class QualityMetrics {
+private:
+    /**
+     * Sums of one 4x4 block pair: a, b, a^2 + b^2 and a * b
+     */
+    struct BlockSums {
+        int sumA;
+        int sumB;
+        int sumSquares;
+        int sumProducts;
+    };
+    
+    /**
+     * Sum of squared differences of two runs of 'n' bytes
+     */
+    static uint64_t squaredError(const uchar* a, const uchar* b, int n) {
+        uint64_t total = 0;
+        int x = 0;
+#if CV_SIMD128
+        // Each lane gains at most 4 * 255^2 per step: flush every 4 KB,
+        // well before the 32-bit accumulator could overflow
+        const int chunk = 4096;
+        while (x <= n - cv::v_uint8x16::nlanes) {
+            int end = std::min(n, x + chunk);
+            cv::v_int32x4 acc = cv::v_setzero_s32();
+            for (; x <= end - cv::v_uint8x16::nlanes; x += cv::v_uint8x16::nlanes) {
+                cv::v_uint16x8 d0, d1;
+                cv::v_expand(cv::v_absdiff(cv::v_load(a + x), cv::v_load(b + x)), d0, d1);
+                cv::v_int16x8 s0 = cv::v_reinterpret_as_s16(d0);
+                cv::v_int16x8 s1 = cv::v_reinterpret_as_s16(d1);
+                acc = cv::v_dotprod(s0, s0, acc);
+                acc = cv::v_dotprod(s1, s1, acc);
+            }
+            total += static_cast<uint64_t>(cv::v_reduce_sum(acc));
+        }
+#endif
+        for (; x < n; x++) {
+            int d = a[x] - b[x];
+            total += static_cast<uint64_t>(d * d);
+        }
+        return total;
+    }
+    
+    static void blockSums(const uchar* a, const uchar* b, size_t stepA, size_t stepB, BlockSums& sums) {
+        sums = {0, 0, 0, 0};
+        for (int y = 0; y < 4; y++, a += stepA, b += stepB) {
+            for (int x = 0; x < 4; x++) {
+                sums.sumA += a[x];
+                sums.sumB += b[x];
+                sums.sumSquares += a[x] * a[x] + b[x] * b[x];
+                sums.sumProducts += a[x] * b[x];
+            }
+        }
+    }
+    
+    /**
+     * Sums of every 4x4 block in the 4-row band starting at row 'y'
+     */
+    static void bandSums(const cv::Mat& a, const cv::Mat& b, int y, std::vector<BlockSums>& band) {
+        int blocks = static_cast<int>(band.size());
+        const uchar* rowA = a.ptr<uchar>(y);
+        const uchar* rowB = b.ptr<uchar>(y);
+        int block = 0;
+#if CV_SIMD128
+        // Two blocks per step: 8 pixels widened to 16 bits, so the pixel
+        // sums stay in 16-bit lanes and the products pair up per block
+        for (; block + 2 <= blocks; block += 2) {
+            cv::v_uint16x8 sumA = cv::v_setzero_u16(), sumB = cv::v_setzero_u16();
+            cv::v_int32x4 squares = cv::v_setzero_s32(), products = cv::v_setzero_s32();
+            for (int r = 0; r < 4; r++) {
+                cv::v_uint16x8 pa = cv::v_load_expand(rowA + r * a.step + block * 4);
+                cv::v_uint16x8 pb = cv::v_load_expand(rowB + r * b.step + block * 4);
+                sumA = cv::v_add_wrap(sumA, pa);
+                sumB = cv::v_add_wrap(sumB, pb);
+                cv::v_int16x8 sa = cv::v_reinterpret_as_s16(pa);
+                cv::v_int16x8 sb = cv::v_reinterpret_as_s16(pb);
+                squares = cv::v_dotprod(sa, sa, squares);
+                squares = cv::v_dotprod(sb, sb, squares);
+                products = cv::v_dotprod(sa, sb, products);
+            }
+            ushort lanesA[8], lanesB[8];
+            int lanesSquares[4], lanesProducts[4];
+            cv::v_store(lanesA, sumA);
+            cv::v_store(lanesB, sumB);
+            cv::v_store(lanesSquares, squares);
+            cv::v_store(lanesProducts, products);
+            for (int half = 0; half < 2; half++) {
+                BlockSums& sums = band[block + half];
+                const ushort* la = lanesA + 4 * half;
+                const ushort* lb = lanesB + 4 * half;
+                sums.sumA = la[0] + la[1] + la[2] + la[3];
+                sums.sumB = lb[0] + lb[1] + lb[2] + lb[3];
+                sums.sumSquares = lanesSquares[2 * half] + lanesSquares[2 * half + 1];
+                sums.sumProducts = lanesProducts[2 * half] + lanesProducts[2 * half + 1];
+            }
+        }
+#endif
+        for (; block < blocks; block++) {
+            blockSums(rowA + block * 4, rowB + block * 4, a.step, b.step, band[block]);
+        }
+    }
+    
+    /**
+     * SSIM of one 8x8 window from the sums of its four 4x4 blocks
+     */
+    static double windowSsim(const BlockSums& b0, const BlockSums& b1, const BlockSums& b2, const BlockSums& b3) {
+        const double c1 = 0.01 * 0.01 * 255 * 255 * 64;
+        const double c2 = 0.03 * 0.03 * 255 * 255 * 64 * 63;
+        double s1 = b0.sumA + b1.sumA + b2.sumA + b3.sumA;
+        double s2 = b0.sumB + b1.sumB + b2.sumB + b3.sumB;
+        double ss = b0.sumSquares + b1.sumSquares + b2.sumSquares + b3.sumSquares;
+        double s12 = b0.sumProducts + b1.sumProducts + b2.sumProducts + b3.sumProducts;
+        double variances = ss * 64 - s1 * s1 - s2 * s2;
+        double covariance = s12 * 64 - s1 * s2;
+        return (2 * s1 * s2 + c1) * (2 * covariance + c2) / ((s1 * s1 + s2 * s2 + c1) * (variances + c2));
+    }
+    
+public:
+    /**
+     * PSNR in dB of two frames of the same size and type; infinite when
+     * they are identical
+     */
+    static double psnr(const cv::Mat& reference, const cv::Mat& distorted) {
+        uint64_t error = 0;
+        int rowBytes = reference.cols * static_cast<int>(reference.elemSize());
+        for (int y = 0; y < reference.rows; y++) {
+            error += squaredError(reference.ptr<uchar>(y), distorted.ptr<uchar>(y), rowBytes);
+        }
+        if (error == 0) {
+            return std::numeric_limits<double>::infinity();
+        }
+        double mse = static_cast<double>(error) / (static_cast<double>(rowBytes) * reference.rows);
+        return 10.0 * std::log10(255.0 * 255.0 / mse);
+    }
+    
+    /**
+     * Mean SSIM of two CV_8UC1 planes of the same size; 1 for frames
+     * smaller than one window
+     */
+    static double ssim(const cv::Mat& reference, const cv::Mat& distorted) {
+        int blocksX = reference.cols / 4;
+        int blocksY = reference.rows / 4;
+        if (blocksX < 2 || blocksY < 2) {
+            return 1.0;
+        }
+        std::vector<BlockSums> previous(blocksX), current(blocksX);
+        bandSums(reference, distorted, 0, previous);
+        double total = 0.0;
+        for (int by = 1; by < blocksY; by++) {
+            bandSums(reference, distorted, by * 4, current);
+            for (int bx = 0; bx + 1 < blocksX; bx++) {
+                total += windowSsim(previous[bx], previous[bx + 1], current[bx], current[bx + 1]);
+            }
+            std::swap(previous, current);
+        }
+        return total / (static_cast<double>(blocksX - 1) * (blocksY - 1));
+    }
+};
+
+/**
+ * Fixed-capacity ring of preallocated frame slots filled by one decode
+ * thread and drained by the playback loop
+ */
+class FrameRingBuffer {
+public:
+    struct Slot {
+        cv::Mat image;
+        cv::UMat gpuImage; // Used instead of 'image' for GPU-resident decoding
+        int frameNumber = -1;
+        double ptsMs = 0.0;
+    };
+    
+private:
+    std::vector<Slot> slots;
+    size_t head;   // Next slot to pop
+    size_t tail;   // Next slot to fill
+    size_t count;
+    bool closed;
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+    
+public:
+    explicit FrameRingBuffer(size_t capacity) 
+        : slots(capacity), head(0), tail(0), count(0), closed(false) {}
+    
+    /**
+     * Preallocate every slot so steady-state decoding reuses the same buffers
+     */
+    void allocate(int rows, int cols, int type) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (Slot& slot : slots) {
+            slot.image.create(rows, cols, type);
+        }
+    }
+    
+    /**
+     * Wait for a free slot and return it for decoding into.
+     * Returns nullptr once the ring has been closed.
+     */
+    Slot* beginWrite() {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] { return closed || count < slots.size(); });
+        if (closed) {
+            return nullptr;
+        }
+        // The tail slot is not visible to the consumer until commitWrite()
+        return &slots[tail];
+    }
+    
+    /**
+     * Non-blocking beginWrite() for pool tasks: nullptr if full or closed
+     */
+    Slot* tryBeginWrite() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closed || count == slots.size()) {
+            return nullptr;
+        }
+        return &slots[tail];
+    }
+    
+    /**
+     * True if a producer could write now
+     */
+    bool hasFreeSlot() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return !closed && count < slots.size();
+    }
+    
+    /**
+     * Publish the slot handed out by beginWrite()
+     */
+    void commitWrite(int frameNumber, double ptsMs) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (closed) {
+                return;
+            }
+            slots[tail].frameNumber = frameNumber;
+            slots[tail].ptsMs = ptsMs;
+            tail = (tail + 1) % slots.size();
+            count++;
+        }
+        notEmpty.notify_one();
+    }
+    
+    /**
+     * Pop the oldest frame, waiting for the producer if necessary.
+     * The slot buffers are swapped with 'image'/'gpuImage' so no pixels are
+     * copied and the caller's previous buffers go back into the ring for reuse.
+     */
+    bool pop(cv::Mat& image, cv::UMat& gpuImage, int& frameNumber, double& ptsMs) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            notEmpty.wait(lock, [this] { return closed || count > 0; });
+            if (count == 0) {
+                return false; // Producer finished or was stopped
+            }
+            cv::swap(image, slots[head].image);
+            cv::swap(gpuImage, slots[head].gpuImage);
+            frameNumber = slots[head].frameNumber;
+            ptsMs = slots[head].ptsMs;
+            head = (head + 1) % slots.size();
+            count--;
+        }
+        notFull.notify_one();
+        return true;
+    }
+    
+    /**
+     * Wake both sides and refuse further writes (end of stream or shutdown)
+     */
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+    
+    /**
+     * Drop queued frames and reopen for a new producer run
+     */
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex);
+        head = tail = count = 0;
+        closed = false;
+    }
+    
+    /**
+     * Number of decoded frames waiting to be presented
+     */
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return count;
+    }
+};
+
+/**
+ * Presents frames against steady_clock deadlines derived from their PTS
+ */
+class PlaybackScheduler {
+private:
+    using Clock = std::chrono::steady_clock;
+    
+    // Re-anchored from the master clock whenever it reports a time
+    mutable Clock::time_point anchorTime;
+    mutable double anchorPtsMs;
+    double rate; // Media milliseconds per wall-clock millisecond
+    int droppedFrames;
+    std::function<double()> masterClock; // Media time now, or < 0 when not running
+    
+public:
+    PlaybackScheduler() : anchorPtsMs(0.0), rate(1.0), droppedFrames(0) {}
+    
+    /**
+     * Playback speed; takes effect from the next anchor()
+     */
+    void setRate(double playbackRate) {
+        rate = playbackRate;
+    }
+    
+    /**
+     * Slave presentation to an external clock (the audio device). While
+     * it reports a time deadlines follow it; when it stops, pacing goes on
+     * from the last time it reported on the steady clock.
+     */
+    void setMasterClock(std::function<double()> clock) {
+        masterClock = std::move(clock);
+    }
+    
+    /**
+     * Map 'ptsMs' to "now"; later frames are due relative to this point
+     */
+    void anchor(double ptsMs) {
+        anchorTime = Clock::now();
+        anchorPtsMs = ptsMs;
+    }
+    
+    /**
+     * Milliseconds until the frame with 'ptsMs' is due, suitable for
+     * cv::waitKey() (never 0, which would block indefinitely)
+     */
+    int delayUntil(double ptsMs) const {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline(ptsMs) - Clock::now()).count();
+        return static_cast<int>(std::max<long long>(1, remaining));
+    }
+    
+    /**
+     * True when the frame's whole display interval has already passed
+     */
+    bool isLate(double ptsMs, double frameDurationMs) const {
+        return Clock::now() > deadline(ptsMs + frameDurationMs);
+    }
+    
+    void countDroppedFrame() {
+        droppedFrames++;
+    }
+    
+    int getDroppedFrames() const {
+        return droppedFrames;
+    }
+    
+private:
+    Clock::time_point deadline(double ptsMs) const {
+        if (masterClock) {
+            double masterMs = masterClock();
+            if (masterMs >= 0.0) {
+                anchorTime = Clock::now();
+                anchorPtsMs = masterMs;
+            }
+        }
+        return anchorTime + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double, std::milli>((ptsMs - anchorPtsMs) / rate));
+    }
+};
+
+/**
+ * Lock-free ring for one producer thread and one consumer thread. The
+ * indices only grow; the capacity is a power of two so they wrap with
+ * a mask. push() and pop() move as many elements as fit or are there.
+ */
+template <typename T>
+class SpscRing {
+private:
+    std::vector<T> slots;
+    size_t mask;
+    alignas(64) std::atomic<size_t> readIndex;  // Advanced by the consumer
+    alignas(64) std::atomic<size_t> writeIndex; // Advanced by the producer
+    
+public:
+    explicit SpscRing(size_t minCapacity) : readIndex(0), writeIndex(0) {
+        size_t capacity = 1;
+        while (capacity < minCapacity) {
+            capacity <<= 1;
+        }
+        slots.resize(capacity);
+        mask = capacity - 1;
+    }
+    
+    size_t push(const T* data, size_t count) {
+        size_t write = writeIndex.load(std::memory_order_relaxed);
+        size_t read = readIndex.load(std::memory_order_acquire);
+        count = std::min(count, slots.size() - (write - read));
+        for (size_t i = 0; i < count; i++) {
+            slots[(write + i) & mask] = data[i];
+        }
+        writeIndex.store(write + count, std::memory_order_release);
+        return count;
+    }
+    
+    size_t pop(T* data, size_t count) {
+        size_t read = readIndex.load(std::memory_order_relaxed);
+        size_t write = writeIndex.load(std::memory_order_acquire);
+        count = std::min(count, write - read);
+        for (size_t i = 0; i < count; i++) {
+            data[i] = slots[(read + i) & mask];
+        }
+        readIndex.store(read + count, std::memory_order_release);
+        return count;
+    }
+    
+    size_t size() const {
+        return writeIndex.load(std::memory_order_acquire) - readIndex.load(std::memory_order_acquire);
+    }
+    
+    /**
+     * Drop everything queued; only while neither side is running
+     */
+    void clear() {
+        readIndex.store(writeIndex.load());
+    }
+};
+
+/**
+ * Blocking 16-bit interleaved PCM output to the default audio device:
+ * waveOut on Windows, ALSA where the build found it. write() returns
+ * once the device has taken the samples, which paces the caller.
+ * Not thread-safe; one thread writes and asks for the position.
+ */
+class AudioSink {
+private:
+    int channels;
+#ifdef _WIN32
+    static constexpr int blockCount = 8;
+    
+    HWAVEOUT device;
+    HANDLE blockDone;
+    std::vector<WAVEHDR> headers;
+    std::vector<std::vector<int16_t>> blocks;
+#elif defined(VIDEOPLAYER_HAVE_ALSA)
+    static constexpr unsigned int latencyUs = 100000;
+    
+    snd_pcm_t* device;
+    int64_t writtenFrames;
+#endif
+    
+public:
+#ifdef _WIN32
+    AudioSink() : channels(0), device(nullptr), blockDone(nullptr) {}
+#elif defined(VIDEOPLAYER_HAVE_ALSA)
+    AudioSink() : channels(0), device(nullptr), writtenFrames(0) {}
+#else
+    AudioSink() : channels(0) {}
+#endif
+    
+    ~AudioSink() {
+        close();
+    }
+    
+    AudioSink(const AudioSink&) = delete;
+    AudioSink& operator=(const AudioSink&) = delete;
+    
+    bool open(int sampleRate, int channelCount) {
+        close();
+        channels = channelCount;
+#ifdef _WIN32
+        WAVEFORMATEX format = {};
+        format.wFormatTag = WAVE_FORMAT_PCM;
+        format.nChannels = static_cast<WORD>(channelCount);
+        format.nSamplesPerSec = static_cast<DWORD>(sampleRate);
+        format.wBitsPerSample = 16;
+        format.nBlockAlign = static_cast<WORD>(channelCount * sizeof(int16_t));
+        format.nAvgBytesPerSec = format.nSamplesPerSec * format.nBlockAlign;
+        blockDone = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+        if (!blockDone || waveOutOpen(&device, WAVE_MAPPER, &format, reinterpret_cast<DWORD_PTR>(blockDone), 
+                                      0, CALLBACK_EVENT) != MMSYSERR_NOERROR) {
+            std::cerr << "Warning: Cannot open the audio device" << std::endl;
+            close();
+            return false;
+        }
+        headers.assign(blockCount, WAVEHDR{});
+        blocks.assign(blockCount, std::vector<int16_t>());
+        return true;
+#elif defined(VIDEOPLAYER_HAVE_ALSA)
+        if (snd_pcm_open(&device, "default", SND_PCM_STREAM_PLAYBACK, 0) < 0) {
+            device = nullptr;
+            std::cerr << "Warning: Cannot open the audio device" << std::endl;
+            return false;
+        }
+        if (snd_pcm_set_params(device, SND_PCM_FORMAT_S16_LE, SND_PCM_ACCESS_RW_INTERLEAVED, 
+                               static_cast<unsigned int>(channelCount), static_cast<unsigned int>(sampleRate), 
+                               1, latencyUs) < 0) {
+            std::cerr << "Warning: Audio device rejected " << sampleRate << " Hz, " 
+                      << channelCount << " channels" << std::endl;
+            close();
+            return false;
+        }
+        writtenFrames = 0;
+        return true;
+#else
+        (void)sampleRate;
+        std::cerr << "Warning: No audio output in this build" << std::endl;
+        return false;
+#endif
+    }
+    
+    bool isOpen() const {
+#if defined(_WIN32) || defined(VIDEOPLAYER_HAVE_ALSA)
+        return device != nullptr;
+#else
+        return false;
+#endif
+    }
+    
+    void close() {
+#ifdef _WIN32
+        if (device) {
+            flush();
+            waveOutClose(device);
+            device = nullptr;
+        }
+        if (blockDone) {
+            CloseHandle(blockDone);
+            blockDone = nullptr;
+        }
+#elif defined(VIDEOPLAYER_HAVE_ALSA)
+        if (device) {
+            snd_pcm_close(device);
+            device = nullptr;
+        }
+#endif
+    }
+    
+    /**
+     * Queue 'frames' frames; waits for device space while 'keepGoing' holds
+     */
+    bool write(const int16_t* samples, size_t frames, const std::atomic<bool>& keepGoing) {
+#ifdef _WIN32
+        int free = -1;
+        while (free < 0) {
+            for (int i = 0; i < blockCount && free < 0; i++) {
+                if (!(headers[i].dwFlags & WHDR_INQUEUE)) {
+                    free = i;
+                }
+            }
+            if (free < 0) {
+                if (!keepGoing) {
+                    return false;
+                }
+                WaitForSingleObject(blockDone, 20);
+            }
+        }
+        WAVEHDR& header = headers[free];
+        if (header.dwFlags & WHDR_PREPARED) {
+            waveOutUnprepareHeader(device, &header, sizeof(WAVEHDR));
+        }
+        blocks[free].assign(samples, samples + frames * channels);
+        header = WAVEHDR{};
+        header.lpData = reinterpret_cast<LPSTR>(blocks[free].data());
+        header.dwBufferLength = static_cast<DWORD>(blocks[free].size() * sizeof(int16_t));
+        return waveOutPrepareHeader(device, &header, sizeof(WAVEHDR)) == MMSYSERR_NOERROR &&
+               waveOutWrite(device, &header, sizeof(WAVEHDR)) == MMSYSERR_NOERROR;
+#elif defined(VIDEOPLAYER_HAVE_ALSA)
+        while (frames > 0) {
+            if (!keepGoing) {
+                return false;
+            }
+            snd_pcm_sframes_t written = snd_pcm_writei(device, samples, frames);
+            if (written < 0) {
+                // Underrun or suspend: recover and retry the same samples
+                if (snd_pcm_recover(device, static_cast<int>(written), 1) < 0) {
+                    return false;
+                }
+                continue;
+            }
+            samples += written * channels;
+            frames -= static_cast<size_t>(written);
+            writtenFrames += written;
+        }
+        return true;
+#else
+        (void)samples;
+        (void)frames;
+        (void)keepGoing;
+        return false;
+#endif
+    }
+    
+    /**
+     * Frames the device has played since open() or the last flush()
+     */
+    int64_t playedFrames() const {
+#ifdef _WIN32
+        MMTIME position = {};
+        position.wType = TIME_SAMPLES;
+        if (waveOutGetPosition(device, &position, sizeof(position)) != MMSYSERR_NOERROR) {
+            return 0;
+        }
+        return position.wType == TIME_SAMPLES ? position.u.sample 
+                                              : position.u.cb / (channels * sizeof(int16_t));
+#elif defined(VIDEOPLAYER_HAVE_ALSA)
+        snd_pcm_sframes_t delay = 0;
+        if (snd_pcm_delay(device, &delay) < 0) {
+            delay = 0;
+        }
+        return std::max<int64_t>(0, writtenFrames - delay);
+#else
+        return 0;
+#endif
+    }
+    
+    /**
+     * Drop queued samples and restart the position at zero
+     */
+    void flush() {
+#ifdef _WIN32
+        waveOutReset(device);
+        for (WAVEHDR& header : headers) {
+            if (header.dwFlags & WHDR_PREPARED) {
+                waveOutUnprepareHeader(device, &header, sizeof(WAVEHDR));
+            }
+        }
+#elif defined(VIDEOPLAYER_HAVE_ALSA)
+        snd_pcm_drop(device);
+        snd_pcm_prepare(device);
+        writtenFrames = 0;
+#endif
+    }
+};
+
+/**
+ * Audio track of a file, decoded on its own audio-only capture and thread
+ * into an SpscRing and played from there by a raised-priority output
+ * thread. Neither thread touches the video pipeline, and the ring holds
+ * bufferMs of audio, so a stalled video decode cannot starve the device.
+ * clockMs() is the media time being heard and is the master clock for
+ * video presentation while the track plays.
+ */
+class AudioPlayer {
+private:
+    static constexpr int bufferMs = 2000;
+    static constexpr int prefillMs = 100; // Queued before output starts
+    static constexpr int chunkMs = 10;    // Per device write
+    
+    std::string path;
+    cv::VideoCapture cap;
+    int sampleRate;
+    int channels;
+    int audioBaseIndex;
+    std::unique_ptr<SpscRing<int16_t>> ring;
+    AudioSink sink;
+    std::thread decodeThread;
+    std::thread outputThread;
+    std::atomic<bool> running;
+    std::atomic<bool> decodeFinished;
+    std::atomic<bool> drained; // Track ended and everything was heard
+    std::atomic<int> underruns;
+    double startPtsMs;
+    
+    // Clock sample taken by the output thread after each write
+    mutable std::mutex clockMutex;
+    int64_t heardFrames;
+    std::chrono::steady_clock::time_point heardAt;
+    bool audible; // The device has played the first write
+    
+    // Silence written on underruns, as (first written frame, length);
+    // owned by the output thread. It comes off the clock as it is played.
+    std::deque<std::pair<int64_t, int64_t>> silences;
+    int64_t silencePlayed;
+    
+    /**
+     * Media frames among the first 'played' frames the device played: the
+     * clock holds while silence plays and never steps back
+     */
+    int64_t mediaFramesPlayed(int64_t played) {
+        while (!silences.empty() && silences.front().first + silences.front().second <= played) {
+            silencePlayed += silences.front().second;
+            silences.pop_front();
+        }
+        int64_t partial = silences.empty() ? 0 : std::max<int64_t>(0, played - silences.front().first);
+        return std::max<int64_t>(0, played - silencePlayed - partial);
+    }
+    
+    void sampleClock(int64_t played) {
+        int64_t heard = mediaFramesPlayed(played);
+        std::lock_guard<std::mutex> lock(clockMutex);
+        heardFrames = heard;
+        heardAt = std::chrono::steady_clock::now();
+        audible = audible || played > 0;
+    }
+    
+public:
+    AudioPlayer() : sampleRate(0), channels(0), audioBaseIndex(0), running(false), 
+                    decodeFinished(false), drained(false), underruns(0), startPtsMs(0.0), heardFrames(0),
+                    audible(false), silencePlayed(0) {}
+    
+    ~AudioPlayer() {
+        stop();
+    }
+    
+    /**
+     * Open the first audio track of 'filename' and the output device.
+     * False, silently, when the file has no audio track.
+     */
+    bool open(const std::string& filename) {
+        stop();
+        path = filename;
+        if (!openCapture()) {
+            return false;
+        }
+        sampleRate = static_cast<int>(cap.get(cv::CAP_PROP_AUDIO_SAMPLES_PER_SECOND));
+        channels = static_cast<int>(cap.get(cv::CAP_PROP_AUDIO_TOTAL_CHANNELS));
+        audioBaseIndex = static_cast<int>(cap.get(cv::CAP_PROP_AUDIO_BASE_INDEX));
+        if (sampleRate <= 0 || channels <= 0 || !sink.open(sampleRate, channels)) {
+            cap.release();
+            return false;
+        }
+        ring = std::make_unique<SpscRing<int16_t>>(static_cast<size_t>(sampleRate) * channels * bufferMs / 1000);
+        return true;
+    }
+    
+    bool isOpen() const {
+        return cap.isOpened() && sink.isOpen();
+    }
+    
+    int getSampleRate() const {
+        return sampleRate;
+    }
+    
+    int getChannels() const {
+        return channels;
+    }
+    
+    /**
+     * Times the device ran dry before the track ended (silence was played)
+     */
+    int getUnderruns() const {
+        return underruns;
+    }
+    
+    /**
+     * Play from 'ptsMs' on, restarting if already playing. Output starts
+     * prefillMs after 'ptsMs' in media time, as the video the caller keeps
+     * pacing meanwhile will have moved on by about that much.
+     */
+    void start(double ptsMs) {
+        stop();
+        if (!isOpen()) {
+            return;
+        }
+        
+        // Seek, then decode one fragment to learn where the stream landed;
+        // samples before the target are dropped by the decode thread. A
+        // backend that seeks by packet may land past the target: playback
+        // then starts where it landed and the video catches up.
+        double targetMs = ptsMs + prefillMs;
+        cap.set(cv::CAP_PROP_POS_MSEC, targetMs);
+        if (!cap.grab()) {
+            return; // Past the end of the track
+        }
+        int64_t target = static_cast<int64_t>(std::llround(targetMs * sampleRate / 1000.0));
+        int64_t landed = static_cast<int64_t>(cap.get(cv::CAP_PROP_AUDIO_POS));
+        int64_t skipFrames = std::max<int64_t>(0, target - landed);
+        startPtsMs = std::max(target, landed) * 1000.0 / sampleRate;
+        
+        {
+            std::lock_guard<std::mutex> lock(clockMutex);
+            heardFrames = 0;
+            heardAt = std::chrono::steady_clock::now();
+            audible = false;
+        }
+        silences.clear();
+        silencePlayed = 0;
+        running = true;
+        decodeFinished = false;
+        drained = false;
+        decodeThread = std::thread(&AudioPlayer::decodeLoop, this, skipFrames);
+        outputThread = std::thread(&AudioPlayer::outputLoop, this);
+    }
+    
+    void stop() {
+        running = false;
+        if (decodeThread.joinable()) {
+            decodeThread.join();
+        }
+        if (outputThread.joinable()) {
+            outputThread.join();
+        }
+        if (sink.isOpen()) {
+            sink.flush();
+        }
+        if (ring) {
+            ring->clear();
+        }
+    }
+    
+    /**
+     * True from start() until stop() or the end of the track, including
+     * while output is still starting
+     */
+    bool isPlaying() const {
+        return running && !drained;
+    }
+    
+    /**
+     * Media time being heard now, or -1 when nothing is (stopped, still
+     * prefilling or seeking, or the track has ended)
+     */
+    double clockMs() const {
+        if (!running || drained) {
+            return -1.0;
+        }
+        std::lock_guard<std::mutex> lock(clockMutex);
+        if (!audible) {
+            return -1.0; // The caller paces on its own clock until then
+        }
+        // Between samples the device plays on; extrapolate up to one chunk
+        double sinceMs = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - heardAt).count();
+        return startPtsMs + heardFrames * 1000.0 / sampleRate + std::min<double>(sinceMs, chunkMs);
+    }
+    
+private:
+    bool openCapture() {
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 7)
+        std::vector<int> params = {
+            cv::CAP_PROP_AUDIO_STREAM, 0,
+            cv::CAP_PROP_VIDEO_STREAM, -1,
+            cv::CAP_PROP_AUDIO_DATA_DEPTH, CV_16S
+        };
+        return cap.open(path, cv::CAP_ANY, params);
+#else
+        std::cerr << "Warning: Audio playback needs OpenCV 4.7 or newer" << std::endl;
+        return false;
+#endif
+    }
+    
+    /**
+     * Best effort; without the privilege (SCHED_FIFO) nothing changes
+     */
+    static void raiseThreadPriority() {
+#ifdef _WIN32
+        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+#else
+        sched_param param = {};
+        param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+        pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+#endif
+    }
+    
+    /**
+     * Interleave each decoded fragment into the ring; start() already
+     * grabbed the first one
+     */
+    void decodeLoop(int64_t skipFrames) {
+        std::vector<cv::Mat> planes(channels);
+        std::vector<int16_t> interleaved;
+        bool grabbed = true;
+        while (running && (grabbed || cap.grab())) {
+            grabbed = false;
+            int frames = std::numeric_limits<int>::max();
+            for (int c = 0; c < channels; c++) {
+                if (!cap.retrieve(planes[c], audioBaseIndex + c) || planes[c].type() != CV_16S) {
+                    frames = 0;
+                    break;
+                }
+                frames = std::min(frames, static_cast<int>(planes[c].total()));
+            }
+            
+            int first = static_cast<int>(std::min<int64_t>(skipFrames, frames));
+            skipFrames -= first;
+            interleaved.resize(static_cast<size_t>(frames - first) * channels);
+            for (int c = 0; c < channels; c++) {
+                const int16_t* plane = planes[c].ptr<int16_t>();
+                for (int i = first; i < frames; i++) {
+                    interleaved[static_cast<size_t>(i - first) * channels + c] = plane[i];
+                }
+            }
+            
+            // Ring full: the device is bufferMs behind, wait for it to drain
+            size_t pushed = 0;
+            while (running && pushed < interleaved.size()) {
+                pushed += ring->push(interleaved.data() + pushed, interleaved.size() - pushed);
+                if (pushed < interleaved.size()) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(chunkMs));
+                }
+            }
+        }
+        decodeFinished = true;
+    }
+    
+    void outputLoop() {
+        raiseThreadPriority();
+        const size_t chunkSamples = static_cast<size_t>(sampleRate) * chunkMs / 1000 * channels;
+        const size_t prefillSamples = static_cast<size_t>(sampleRate) * prefillMs / 1000 * channels;
+        while (running && !decodeFinished && ring->size() < prefillSamples) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        
+        std::vector<int16_t> chunk(chunkSamples);
+        int64_t writtenFrames = 0;
+        while (running) {
+            // Whole frames only; the producer may have pushed part of one
+            size_t available = ring->size();
+            size_t take = std::min(chunkSamples, available - available % channels);
+            ring->pop(chunk.data(), take);
+            if (take < chunkSamples) {
+                if (decodeFinished && take == 0) {
+                    break;
+                }
+                if (!decodeFinished) {
+                    underruns++;
+                    // Written but not media: kept off the clock once played
+                    silences.emplace_back(writtenFrames + static_cast<int64_t>(take) / channels,
+                                          static_cast<int64_t>(chunkSamples - take) / channels);
+                    std::fill(chunk.begin() + take, chunk.end(), 0);
+                    take = chunkSamples;
+                }
+            }
+            writtenFrames += static_cast<int64_t>(take) / channels;
+            if (!sink.write(chunk.data(), take / channels, running)) {
+                break;
+            }
+            
+            sampleClock(std::min(sink.playedFrames(), writtenFrames));
+        }
+        
+        // Let the tail play out, keeping the clock moving until it has
+        while (running && sink.playedFrames() < writtenFrames) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(chunkMs));
+            sampleClock(std::min(sink.playedFrames(), writtenFrames));
+        }
+        drained = true;
+    }
+};
+
+/**
+ * Keyframe positions and per-frame timestamps of a video, built once from
+ * the container's packets so seeks can start at a known keyframe
+ */
+class KeyframeIndex {
+public:
+    /**
+     * Stream properties stored alongside the index in the sidecar
+     */
+    struct StreamInfo {
+        int frameCount = 0;
+        double fps = 0.0;
+        int width = 0;
+        int height = 0;
+    };
+    
+private:
+    static constexpr uint32_t sidecarVersion = 1;
+    
+public:
+    static constexpr int64_t demuxSlackBytes = 64 << 10; // Read-buffer uncertainty of offsets
+    static constexpr bool recordsByteOffsets = 
+        CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 11);
+    
+private:
+    
+    struct SidecarHeader {
+        char magic[8];
+        uint32_t version;
+        int32_t frameCount;
+        uint64_t videoSize;
+        int64_t videoMtime;
+        double fps;
+        int32_t width;
+        int32_t height;
+        uint32_t keyframeCount;
+        uint32_t ptsCount;
+    };
+    
+    std::vector<int> keyframes;          // Sorted frame numbers of keyframes
+    std::vector<int64_t> keyframeOffsets; // Byte offset of each keyframe, -1 if unknown
+    std::vector<double> framePtsMs;      // Presentation timestamps in display order
+    int packetCount;                     // Frames counted while scanning
+    
+    /**
+     * Read 'count' values, but only if that many bytes are left: a corrupt
+     * count must not allocate more than the file holds
+     */
+    template <typename T>
+    static bool readArray(std::istream& in, std::vector<T>& values, size_t count, uint64_t& remainingBytes) {
+        if (count > remainingBytes / sizeof(T)) {
+            return false;
+        }
+        values.resize(count);
+        in.read(reinterpret_cast<char*>(values.data()), count * sizeof(T));
+        remainingBytes -= count * sizeof(T);
+        return static_cast<bool>(in);
+    }
+    
+    /**
+     * Checks a loaded index the way build() would have produced it: the
+     * first keyframe is frame 0, keyframes ascend within the stream and
+     * timestamps, if any, cover every frame
+     */
+    static bool plausible(const SidecarHeader& header, const std::vector<int32_t>& storedKeyframes) {
+        if (header.frameCount <= 0 || !(header.fps > 0.0) || storedKeyframes.front() != 0 ||
+            storedKeyframes.back() >= header.frameCount ||
+            (header.ptsCount != 0 && header.ptsCount != static_cast<uint32_t>(header.frameCount))) {
+            return false;
+        }
+        return std::adjacent_find(storedKeyframes.begin(), storedKeyframes.end(), 
+                                  std::greater_equal<int32_t>()) == storedKeyframes.end();
+    }
+    
+    template <typename T>
+    static void writeArray(std::ostream& out, const std::vector<T>& values) {
+        out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+    
+public:
+    KeyframeIndex() : packetCount(0) {}
+    
+    /**
+     * Load a sidecar written by save() for this exact video file (same size
+     * and mtime). On success no container probing is needed. A truncated
+     * or inconsistent sidecar is rejected, and the file gets rescanned.
+     */
+    bool load(const std::string& path, const FileStamp& stamp, StreamInfo& info) {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        SidecarHeader header;
+        if (!in || !stamp.valid()) {
+            return false;
+        }
+        std::streamoff fileBytes = in.tellg();
+        in.seekg(0);
+        if (fileBytes < static_cast<std::streamoff>(sizeof(header)) || 
+            !in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+            return false;
+        }
+        uint64_t remainingBytes = static_cast<uint64_t>(fileBytes) - sizeof(header);
+        if (std::memcmp(header.magic, "VPINDEX", 8) != 0 || header.version != sidecarVersion ||
+            header.videoSize != stamp.size || header.videoMtime != stamp.mtime ||
+            header.keyframeCount == 0) {
+            return false;
+        }
+        
+        std::vector<int32_t> storedKeyframes;
+        if (!readArray(in, storedKeyframes, header.keyframeCount, remainingBytes) ||
+            !readArray(in, keyframeOffsets, header.keyframeCount, remainingBytes) ||
+            !readArray(in, framePtsMs, header.ptsCount, remainingBytes) ||
+            !plausible(header, storedKeyframes)) {
+            keyframeOffsets.clear();
+            framePtsMs.clear();
+            return false;
+        }
+        keyframes.assign(storedKeyframes.begin(), storedKeyframes.end());
+        packetCount = header.frameCount;
+        
+        info.frameCount = header.frameCount;
+        info.fps = header.fps;
+        info.width = header.width;
+        info.height = header.height;
+        return true;
+    }
+    
+    /**
+     * Write the index and stream info next to the video. The file is written
+     * under a temporary name and renamed so readers never see a partial one.
+     */
+    bool save(const std::string& path, const FileStamp& stamp, const StreamInfo& info) const {
+        if (keyframes.empty() || !stamp.valid()) {
+            return false;
+        }
+        std::string tempPath = path + ".tmp";
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            if (!out) {
+                return false;
+            }
+            SidecarHeader header = {};
+            std::memcpy(header.magic, "VPINDEX", 8);
+            header.version = sidecarVersion;
+            header.frameCount = info.frameCount;
+            header.videoSize = stamp.size;
+            header.videoMtime = stamp.mtime;
+            header.fps = info.fps;
+            header.width = info.width;
+            header.height = info.height;
+            header.keyframeCount = static_cast<uint32_t>(keyframes.size());
+            header.ptsCount = static_cast<uint32_t>(framePtsMs.size());
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            writeArray(out, std::vector<int32_t>(keyframes.begin(), keyframes.end()));
+            writeArray(out, keyframeOffsets);
+            writeArray(out, framePtsMs);
+            if (!out) {
+                return false;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(tempPath, path, error);
+        return !error;
+    }
+    
+    /**
+     * Scan packets without decoding them (FFmpeg raw mode). Returns false if
+     * the backend cannot report keyframe flags; the index is then empty.
+     * Scanning through 'mapping' (OpenCV 4.11+) also records approximate
+     * keyframe byte offsets, at most demuxSlackBytes before the keyframe.
+     * Gives up, leaving the index empty, when '*cancel' is set.
+     */
+    bool build(const std::string& filename, const MappedFile* mapping = nullptr, 
+               const std::atomic<bool>* cancel = nullptr) {
+        keyframes.clear();
+        keyframeOffsets.clear();
+        framePtsMs.clear();
+        packetCount = 0;
+        
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 7)
+        cv::VideoCapture packets;
+        int64_t streamPosition = -1; // Bytes the demuxer consumed, -1 if not observable
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 11)
+        cv::Ptr<MappedStreamReader> reader;
+        if (mapping && mapping->data()) {
+            reader = cv::makePtr<MappedStreamReader>(*mapping);
+            if (packets.open(reader, cv::CAP_FFMPEG, {cv::CAP_PROP_FORMAT, -1})) {
+                streamPosition = 0;
+            }
+        }
+#else
+        (void)mapping;
+#endif
+        if (!packets.isOpened() && !packets.open(filename, cv::CAP_FFMPEG, {cv::CAP_PROP_FORMAT, -1})) {
+            return false;
+        }
+        
+        // Packets arrive in decode order, so a keyframe's decode index is its
+        // display index (exact for closed GOPs); timestamps are sorted after.
+        // A packet starts at most one demuxer buffer before the position
+        // reached after the previous packet.
+        int packetIndex = 0;
+        while (!(cancel && *cancel) && packets.grab()) {
+            if (packets.get(cv::CAP_PROP_LRF_HAS_KEY_FRAME) > 0) {
+                keyframes.push_back(packetIndex);
+                keyframeOffsets.push_back(streamPosition < 0 ? -1 : 
+                                          std::max<int64_t>(0, streamPosition - demuxSlackBytes));
+            }
+            framePtsMs.push_back(packets.get(cv::CAP_PROP_POS_MSEC));
+            packetIndex++;
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 11)
+            if (streamPosition >= 0) {
+                streamPosition = reader->tell();
+            }
+#endif
+        }
+        packetCount = packetIndex;
+        std::sort(framePtsMs.begin(), framePtsMs.end());
+        if (!framePtsMs.empty() && framePtsMs.back() <= 0.0) {
+            framePtsMs.clear(); // Backend did not report packet timestamps
+        }
+#else
+        (void)filename; // No raw packet mode before OpenCV 4.7
+        (void)mapping;
+#endif
+        
+        if (keyframes.empty() || keyframes.front() != 0 || (cancel && *cancel)) {
+            keyframes.clear(); // No usable keyframe information
+            keyframeOffsets.clear();
+            framePtsMs.clear();
+            return false;
+        }
+        return true;
+    }
+    
+    /**
+     * Number of frames found while scanning, 0 if not indexed. Unlike
+     * CAP_PROP_FRAME_COUNT this does not trust the container header.
+     */
+    int frameCount() const {
+        return packetCount;
+    }
+    
+    bool empty() const {
+        return keyframes.empty();
+    }
+    
+    size_t keyframeCount() const {
+        return keyframes.size();
+    }
+    
+    const std::vector<int>& getKeyframes() const {
+        return keyframes;
+    }
+    
+    /**
+     * Container timestamp of 'frameNumber', or -1 if not indexed
+     */
+    double ptsOf(int frameNumber) const {
+        if (frameNumber < 0 || frameNumber >= static_cast<int>(framePtsMs.size())) {
+            return -1.0;
+        }
+        return framePtsMs[frameNumber];
+    }
+    
+    bool hasByteOffsets() const {
+        return !keyframeOffsets.empty() && keyframeOffsets.front() >= 0;
+    }
+    
+    /**
+     * Approximate byte offset of the keyframe at or before 'frameNumber',
+     * or -1 if unknown
+     */
+    int64_t byteOffsetOf(int frameNumber) const {
+        auto it = std::upper_bound(keyframes.begin(), keyframes.end(), frameNumber);
+        if (it == keyframes.begin() || keyframeOffsets.size() != keyframes.size()) {
+            return -1;
+        }
+        return keyframeOffsets[it - keyframes.begin() - 1];
+    }
+    
+    /**
+     * First keyframe at or after 'frameNumber', or -1 if none is known
+     */
+    int keyframeAtOrAfter(int frameNumber) const {
+        auto it = std::lower_bound(keyframes.begin(), keyframes.end(), frameNumber);
+        return it == keyframes.end() ? -1 : *it;
+    }
+    
+    /**
+     * Last keyframe at or before 'frameNumber', or -1 if unknown
+     */
+    int keyframeAtOrBefore(int frameNumber) const {
+        auto it = std::upper_bound(keyframes.begin(), keyframes.end(), frameNumber);
+        if (it == keyframes.begin()) {
+            return -1;
+        }
+        return *(it - 1);
+    }
+};
+
+/**
+ * Run of consecutive decoded frames [firstFrame, firstFrame + count) used to
+ * step backward through a GOP after decoding it forward once
+ */
+class FrameRangeCache {
+private:
+    std::vector<cv::Mat> frames; // Buffers are kept and reused across refills
+    std::vector<double> ptsMs;
+    int firstFrame;
+    int count;
+    
+public:
+    FrameRangeCache() : firstFrame(0), count(0) {}
+    
+    void setCapacity(size_t capacity) {
+        frames.resize(capacity);
+        ptsMs.resize(capacity);
+        count = 0;
+    }
+    
+    size_t capacity() const {
+        return frames.size();
+    }
+    
+    void clear() {
+        count = 0;
+    }
+    
+    bool contains(int frameNumber) const {
+        return frameNumber >= firstFrame && frameNumber < firstFrame + count;
+    }
+    
+    /**
+     * Start a new run at 'frameNumber', discarding the previous one
+     */
+    void beginFill(int frameNumber) {
+        firstFrame = frameNumber;
+        count = 0;
+    }
+    
+    /**
+     * Buffer for the next frame of the run; publish it with commitFill()
+     */
+    cv::Mat& nextSlot() {
+        return frames[count];
+    }
+    
+    void commitFill(double pts) {
+        ptsMs[count] = pts;
+        count++;
+    }
+    
+    bool full() const {
+        return count == static_cast<int>(frames.size());
+    }
+    
+    const cv::Mat& frame(int frameNumber) const {
+        return frames[frameNumber - firstFrame];
+    }
+    
+    double pts(int frameNumber) const {
+        return ptsMs[frameNumber - firstFrame];
+    }
+};
+
+/**
+ * LRU cache of decoded frames keyed by frame number, bounded by a byte
+ * budget. Thread-safe: the prefetcher inserts while the UI thread looks up.
+ */
+class FrameCache {
+private:
+    struct Entry {
+        int frameNumber;
+        cv::Mat image;
+        double ptsMs;
+    };
+    
+    std::list<Entry> entries; // Most recently used first
+    std::unordered_map<int, std::list<Entry>::iterator> lookupTable;
+    size_t budgetBytes;
+    size_t usedBytes;
+    size_t hits;
+    size_t misses;
+    mutable std::mutex mutex;
+    
+    static size_t bytesOf(const cv::Mat& image) {
+        return image.total() * image.elemSize();
+    }
+    
+public:
+    explicit FrameCache(size_t budgetBytes) 
+        : budgetBytes(budgetBytes), usedBytes(0), hits(0), misses(0) {}
+    
+    /**
+     * Change the byte budget, evicting least recently used frames to fit
+     */
+    void setBudget(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        budgetBytes = bytes;
+        while (usedBytes > budgetBytes && !entries.empty()) {
+            usedBytes -= bytesOf(entries.back().image);
+            lookupTable.erase(entries.back().frameNumber);
+            entries.pop_back();
+        }
+    }
+    
+    /**
+     * Copy a cached frame into 'image' and mark it most recently used
+     */
+    bool lookup(int frameNumber, cv::Mat& image, double& ptsMs) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = lookupTable.find(frameNumber);
+        if (it == lookupTable.end()) {
+            misses++;
+            return false;
+        }
+        hits++;
+        entries.splice(entries.begin(), entries, it->second);
+        it->second->image.copyTo(image);
+        ptsMs = it->second->ptsMs;
+        return true;
+    }
+    
+    /**
+     * Store a copy of 'image'. Once the budget is reached the evicted frame's
+     * buffer is reused for the new entry, so a full cache stops allocating.
+     */
+    void insert(int frameNumber, const cv::Mat& image, double ptsMs) {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t bytes = bytesOf(image);
+        if (bytes > budgetBytes || lookupTable.count(frameNumber)) {
+            return;
+        }
+        
+        cv::Mat recycled;
+        while (usedBytes + bytes > budgetBytes) {
+            Entry& victim = entries.back();
+            usedBytes -= bytesOf(victim.image);
+            lookupTable.erase(victim.frameNumber);
+            recycled = victim.image;
+            entries.pop_back();
+        }
+        
+        entries.push_front(Entry{frameNumber, recycled, ptsMs});
+        image.copyTo(entries.front().image);
+        lookupTable[frameNumber] = entries.begin();
+        usedBytes += bytes;
+    }
+    
+    /**
+     * Cached frame closest to 'frameNumber', or -1 if the cache is empty
+     */
+    int nearest(int frameNumber) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        int best = -1;
+        for (const auto& entry : lookupTable) {
+            if (best < 0 || std::abs(entry.first - frameNumber) < std::abs(best - frameNumber)) {
+                best = entry.first;
+            }
+        }
+        return best;
+    }
+    
+    /**
+     * True if 'frameNumber' is cached; unlike lookup() not counted as a hit
+     */
+    bool contains(int frameNumber) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return lookupTable.count(frameNumber) > 0;
+    }
+    
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.clear();
+        lookupTable.clear();
+        usedBytes = 0;
+    }
+    
+    size_t getHits() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return hits;
+    }
+    
+    size_t getMisses() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return misses;
+    }
+    
+    size_t getFrameCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+    
+    size_t getUsedBytes() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return usedBytes;
+    }
+};
+
+/**
+ * Strip of keyframe thumbnails shown under the main window. Thumbnails are
+ * extracted in parallel in the background and cached next to the video as
+ * one atlas file (header, frame numbers, then a single BGR image with all
+ * thumbnails side by side) that is memory-mapped on the next load.
+ */
+class Filmstrip {
+private:
+    static constexpr int thumbHeight = 72;
+    static constexpr int maxThumbnails = 512;
+    static constexpr uint32_t atlasVersion = 1;
+    
+    struct AtlasHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t count;
+        uint64_t videoSize;
+        int64_t videoMtime;
+        int32_t thumbWidth;
+        int32_t thumbHeight;
+    };
+    
+    std::vector<int> thumbFrames; // Frame number of each thumbnail
+    cv::Mat atlas;                // thumbHeight x (count * thumbWidth), may view atlasFile
+    MappedFile atlasFile;
+    int thumbWidth;
+    ToneCurve toneCurve; // The player's tone mapping, for high-bit-depth sources
+    int toneBits;
+    std::atomic<bool> ready;
+    std::atomic<bool> cancelled;
+    std::thread generator;
+    
+    // Last rendered view, reused between frames
+    cv::Mat view;
+    int viewFirstThumb;
+    
+    static std::string atlasPath(const std::string& videoFile) {
+        return videoFile + ".vpstrip";
+    }
+    
+    /**
+     * Map an existing atlas if it was built from this exact video file
+     */
+    bool loadAtlas(const std::string& path, const FileStamp& stamp) {
+        if (!atlasFile.open(path) || atlasFile.size() < sizeof(AtlasHeader)) {
+            return false;
+        }
+        AtlasHeader header;
+        std::memcpy(&header, atlasFile.data(), sizeof(header));
+        size_t framesBytes = header.count * sizeof(int32_t);
+        size_t pixelBytes = size_t(header.count) * header.thumbWidth * header.thumbHeight * 3;
+        if (std::memcmp(header.magic, "VPSTRIP", 8) != 0 || header.version != atlasVersion ||
+            header.videoSize != stamp.size || header.videoMtime != stamp.mtime ||
+            header.count == 0 || atlasFile.size() != sizeof(header) + framesBytes + pixelBytes) {
+            atlasFile.close();
+            return false;
+        }
+        
+        const unsigned char* frames = atlasFile.data() + sizeof(header);
+        thumbFrames.resize(header.count);
+        std::memcpy(thumbFrames.data(), frames, framesBytes);
+        thumbWidth = header.thumbWidth;
+        
+        // The atlas Mat views the mapping directly; pages load on demand
+        atlas = cv::Mat(header.thumbHeight, header.count * header.thumbWidth, CV_8UC3,
+                        const_cast<unsigned char*>(frames + framesBytes));
+        return true;
+    }
+    
+    bool writeAtlas(const std::string& path, const FileStamp& stamp) const {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+        AtlasHeader header = {};
+        std::memcpy(header.magic, "VPSTRIP", 8);
+        header.version = atlasVersion;
+        header.count = static_cast<uint32_t>(thumbFrames.size());
+        header.videoSize = stamp.size;
+        header.videoMtime = stamp.mtime;
+        header.thumbWidth = thumbWidth;
+        header.thumbHeight = thumbHeight;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(thumbFrames.data()), thumbFrames.size() * sizeof(int32_t));
+        for (int y = 0; y < atlas.rows; y++) {
+            out.write(reinterpret_cast<const char*>(atlas.ptr(y)), atlas.cols * 3);
+        }
+        return static_cast<bool>(out);
+    }
+    
+    /**
+     * Background job: decode the keyframes on a pool, each task with its own
+     * capture, resizing straight into the task's columns of the atlas
+     */
+    void generate(std::string videoFile, FileStamp stamp) {
+        {
+            WorkStealingPool pool;
+            size_t chunkCount = pool.size() * 2;
+            size_t chunkSize = (thumbFrames.size() + chunkCount - 1) / chunkCount;
+            for (size_t first = 0; first < thumbFrames.size(); first += chunkSize) {
+                size_t last = std::min(thumbFrames.size(), first + chunkSize);
+                pool.submit([this, videoFile, first, last] {
+                    cv::VideoCapture capture(videoFile);
+                    cv::Mat frame, small;
+                    ToneMapper toneMapper(toneCurve, toneBits); // One per chunk, at the stream's depth
+                    for (size_t i = first; i < last && !cancelled; i++) {
+                        capture.set(cv::CAP_PROP_POS_FRAMES, thumbFrames[i]);
+                        if (capture.read(frame)) {
+                            cv::Mat thumb = atlas(cv::Rect(static_cast<int>(i) * thumbWidth, 0, 
+                                                           thumbWidth, thumbHeight));
+                            if (ToneMapper::needsMapping(frame)) {
+                                // Scale at full depth, then map straight into the atlas
+                                cv::resize(frame, small, thumb.size(), 0, 0, cv::INTER_AREA);
+                                toneMapper.apply(small, thumb);
+                            } else {
+                                cv::resize(frame, thumb, thumb.size(), 0, 0, cv::INTER_AREA);
+                            }
+                        }
+                    }
+                });
+            }
+        } // Pool destructor waits for every chunk
+        
+        if (cancelled) {
+            return;
+        }
+        
+        // Prefer the mapped copy so the in-memory atlas can be released;
+        // on read-only media keep the in-memory one
+        std::string path = atlasPath(videoFile);
+        if (writeAtlas(path, stamp)) {
+            cv::Mat generated = atlas;
+            std::vector<int> frames = thumbFrames;
+            if (!loadAtlas(path, stamp)) {
+                atlas = generated;
+                thumbFrames = frames;
+            }
+        }
+        ready.store(true, std::memory_order_release);
+    }
+    
+public:
+    Filmstrip() : thumbWidth(0), toneCurve(ToneCurve::Linear), toneBits(10), ready(false), cancelled(false), 
+                  viewFirstThumb(0) {}
+    
+    ~Filmstrip() {
+        cancel();
+    }
+    
+    /**
+     * Stop a running generation and drop the current strip
+     */
+    void cancel() {
+        cancelled = true;
+        if (generator.joinable()) {
+            generator.join();
+        }
+        ready = false;
+        cancelled = false;
+        atlas.release();
+        atlasFile.close();
+    }
+    
+    /**
+     * Open the cached atlas for 'videoFile' or start generating one from
+     * 'keyframes' in the background, tone mapping like 'toneMapping'.
+     * Never blocks on decoding.
+     */
+    void load(const std::string& videoFile, const std::vector<int>& keyframes, cv::Size frameSize,
+              const ToneMapper& toneMapping) {
+        cancel();
+        if (keyframes.empty() || frameSize.height == 0) {
+            return;
+        }
+        toneCurve = toneMapping.getCurve();
+        toneBits = toneMapping.getSignificantBits();
+        
+        FileStamp stamp = FileStamp::of(videoFile);
+        if (loadAtlas(atlasPath(videoFile), stamp)) {
+            ready = true;
+            return;
+        }
+        
+        // Evenly thin out very long keyframe lists
+        thumbFrames.clear();
+        size_t count = std::min<size_t>(keyframes.size(), maxThumbnails);
+        for (size_t i = 0; i < count; i++) {
+            thumbFrames.push_back(keyframes[i * keyframes.size() / count]);
+        }
+        thumbWidth = std::max(1, thumbHeight * frameSize.width / frameSize.height);
+        atlas = cv::Mat::zeros(thumbHeight, static_cast<int>(count) * thumbWidth, CV_8UC3);
+        
+        generator = std::thread(&Filmstrip::generate, this, videoFile, stamp);
+    }
+    
+    bool isReady() const {
+        return ready.load(std::memory_order_acquire);
+    }
+    
+    /**
+     * Render the thumbnails around 'frameNumber' with the current one
+     * highlighted and a progress bar underneath, into a reused image
+     */
+    const cv::Mat& render(int frameNumber, int totalFrames, int width) {
+        int thumbCount = static_cast<int>(thumbFrames.size());
+        int visible = std::min(thumbCount, std::max(1, width / thumbWidth));
+        int current = static_cast<int>(std::upper_bound(thumbFrames.begin(), thumbFrames.end(), 
+                                                        frameNumber) - thumbFrames.begin()) - 1;
+        current = std::max(0, current);
+        viewFirstThumb = std::min(std::max(0, current - visible / 2), thumbCount - visible);
+        
+        view.create(thumbHeight + 8, width, CV_8UC3);
+        view.setTo(cv::Scalar(0, 0, 0));
+        atlas(cv::Rect(viewFirstThumb * thumbWidth, 0, visible * thumbWidth, thumbHeight))
+            .copyTo(view(cv::Rect(0, 0, visible * thumbWidth, thumbHeight)));
+        
+        cv::rectangle(view, cv::Rect((current - viewFirstThumb) * thumbWidth, 0, thumbWidth, thumbHeight),
+                      cv::Scalar(0, 255, 255), 2);
+        int progress = totalFrames > 0 ? width * (frameNumber + 1) / totalFrames : 0;
+        cv::rectangle(view, cv::Rect(0, thumbHeight + 2, progress, 4), cv::Scalar(0, 255, 0), cv::FILLED);
+        return view;
+    }
+    
+    /**
+     * Thumbnail of the last thumbnailed keyframe at or before 'frameNumber'
+     * as a view into the atlas; returns its frame number, or -1
+     */
+    int thumbnailBefore(int frameNumber, cv::Mat& thumbnail) const {
+        if (!isReady()) {
+            return -1;
+        }
+        int index = static_cast<int>(std::upper_bound(thumbFrames.begin(), thumbFrames.end(), 
+                                                      frameNumber) - thumbFrames.begin()) - 1;
+        if (index < 0) {
+            return -1;
+        }
+        thumbnail = atlas(cv::Rect(index * thumbWidth, 0, thumbWidth, thumbHeight));
+        return thumbFrames[index];
+    }
+    
+    /**
+     * Keyframe under x in the last rendered view, or -1
+     */
+    int frameAt(int x) const {
+        if (!isReady() || thumbWidth == 0) {
+            return -1;
+        }
+        int index = viewFirstThumb + x / thumbWidth;
+        if (x < 0 || index >= static_cast<int>(thumbFrames.size())) {
+            return -1;
+        }
+        return thumbFrames[index];
+    }
+};
+
+/**
+ * Scene-cut index: frames where a new shot starts, found by comparing
+ * colour histograms of heavily downsampled consecutive frames. The file is
+ * analysed in segments split at keyframes, one capture per task on a
+ * WorkStealingPool, and the result is cached next to the video.
+ */
+class SceneIndex {
+private:
+    static constexpr uint32_t indexVersion = 1;
+    static constexpr int histogramBins = 16;    // Per colour channel
+    static constexpr double cutThreshold = 0.3; // Normalised L1 histogram distance
+    static constexpr int minSceneFrames = 12;   // Suppresses flashes and fast pans
+    
+    using Histogram = std::array<float, 3 * histogramBins>;
+    
+    struct IndexHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t count;
+        uint64_t videoSize;
+        int64_t videoMtime;
+    };
+    
+    struct Segment {
+        int first;
+        int last;
+        Histogram head;          // First and last frame, to compare across
+        Histogram tail;          // segment boundaries afterwards
+        bool complete = false;   // Decoded through 'last'
+        std::vector<int> cuts;
+    };
+    
+    std::vector<int> cuts; // Sorted; published through 'ready'
+    std::atomic<bool> ready;
+    std::atomic<bool> cancelled;
+    std::atomic<int> analysedFrames;
+    int totalFrames;
+    int toneBits; // Depth of high-bit-depth sources, fixed by the player
+    std::thread analyser;
+    
+    static std::string indexPath(const std::string& videoFile) {
+        return videoFile + ".vpscene";
+    }
+    
+    /**
+     * Per-channel histograms of a 64x36 version of 'frame', each summing to 1
+     */
+    static void histogramOf(const cv::Mat& frame, cv::Mat& small, Histogram& histogram) {
+        cv::resize(frame, small, cv::Size(64, 36), 0, 0, cv::INTER_AREA);
+        histogram.fill(0.0f);
+        for (int y = 0; y < small.rows; y++) {
+            const uchar* p = small.ptr<uchar>(y);
+            for (int x = 0; x < small.cols; x++, p += 3) {
+                histogram[p[0] >> 4]++;
+                histogram[histogramBins + (p[1] >> 4)]++;
+                histogram[2 * histogramBins + (p[2] >> 4)]++;
+            }
+        }
+        float scale = 1.0f / (small.rows * small.cols);
+        for (float& bin : histogram) {
+            bin *= scale;
+        }
+    }
+    
+    /**
+     * 0 for identical colour distributions, 1 for disjoint ones
+     */
+    static double distance(const Histogram& a, const Histogram& b) {
+        double sum = 0.0;
+        for (size_t i = 0; i < a.size(); i++) {
+            sum += std::abs(a[i] - b[i]);
+        }
+        return sum / 6.0; // Three channels, each at most 2 apart
+    }
+    
+    bool readIndex(const std::string& path, const FileStamp& stamp) {
+        std::ifstream in(path, std::ios::binary);
+        IndexHeader header;
+        if (!in || !stamp.valid() || !in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+            return false;
+        }
+        if (std::memcmp(header.magic, "VPSCENE", 8) != 0 || header.version != indexVersion ||
+            header.videoSize != stamp.size || header.videoMtime != stamp.mtime) {
+            return false;
+        }
+        std::vector<int32_t> stored(header.count);
+        if (!in.read(reinterpret_cast<char*>(stored.data()), stored.size() * sizeof(int32_t))) {
+            return false;
+        }
+        cuts.assign(stored.begin(), stored.end());
+        return true;
+    }
+    
+    bool writeIndex(const std::string& path, const FileStamp& stamp) const {
+        std::string tempPath = path + ".tmp";
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            if (!out) {
+                return false;
+            }
+            IndexHeader header = {};
+            std::memcpy(header.magic, "VPSCENE", 8);
+            header.version = indexVersion;
+            header.count = static_cast<uint32_t>(cuts.size());
+            header.videoSize = stamp.size;
+            header.videoMtime = stamp.mtime;
+            std::vector<int32_t> stored(cuts.begin(), cuts.end());
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(stored.data()), stored.size() * sizeof(int32_t));
+            if (!out) {
+                return false;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(tempPath, path, error);
+        return !error;
+    }
+    
+    /**
+     * Decode one segment sequentially and record the cuts inside it
+     */
+    void analyseSegment(const std::string& videoFile, Segment& segment) {
+        cv::VideoCapture capture(videoFile);
+        if (segment.first > 0) {
+            capture.set(cv::CAP_PROP_POS_FRAMES, segment.first); // A keyframe: cheap and exact
+        }
+        cv::Mat frame, mapped, small;
+        ToneMapper toneMapper(ToneCurve::Linear, toneBits);
+        Histogram previous = {}, current = {};
+        int frameNumber = segment.first;
+        for (; frameNumber <= segment.last && !cancelled; frameNumber++) {
+            if (!capture.read(frame)) {
+                break;
+            }
+            if (toneMapper.apply(frame, mapped)) {
+                cv::swap(frame, mapped);
+            }
+            if (frame.type() != CV_8UC3) {
+                break;
+            }
+            histogramOf(frame, small, current);
+            if (frameNumber == segment.first) {
+                segment.head = current;
+            } else if (distance(previous, current) > cutThreshold) {
+                segment.cuts.push_back(frameNumber);
+            }
+            previous = current;
+            analysedFrames++;
+        }
+        segment.tail = previous;
+        segment.complete = frameNumber > segment.last;
+    }
+    
+    /**
+     * Background job: analyse the segments in parallel, then stitch the
+     * boundaries and drop cuts closer together than minSceneFrames
+     */
+    void analyse(std::string videoFile, FileStamp stamp, std::vector<int> boundaries) {
+        std::vector<Segment> segments(boundaries.size());
+        {
+            WorkStealingPool pool;
+            for (size_t i = 0; i < boundaries.size(); i++) {
+                segments[i].first = boundaries[i];
+                segments[i].last = (i + 1 < boundaries.size() ? boundaries[i + 1] : totalFrames) - 1;
+                Segment* segment = &segments[i];
+                pool.submit([this, videoFile, segment] { analyseSegment(videoFile, *segment); });
+            }
+        } // Pool destructor waits for every segment
+        
+        if (cancelled) {
+            return;
+        }
+        
+        std::vector<int> candidates;
+        for (size_t i = 0; i < segments.size(); i++) {
+            if (i > 0 && segments[i - 1].complete && 
+                distance(segments[i - 1].tail, segments[i].head) > cutThreshold) {
+                candidates.push_back(segments[i].first);
+            }
+            candidates.insert(candidates.end(), segments[i].cuts.begin(), segments[i].cuts.end());
+        }
+        cuts.clear();
+        int lastCut = 0;
+        for (int candidate : candidates) {
+            if (candidate - lastCut >= minSceneFrames) {
+                cuts.push_back(candidate);
+                lastCut = candidate;
+            }
+        }
+        writeIndex(indexPath(videoFile), stamp);
+        ready.store(true, std::memory_order_release);
+    }
+    
+public:
+    SceneIndex() : ready(false), cancelled(false), analysedFrames(0), totalFrames(0), toneBits(10) {}
+    
+    ~SceneIndex() {
+        cancel();
+    }
+    
+    /**
+     * Stop a running analysis and drop the current index
+     */
+    void cancel() {
+        cancelled = true;
+        if (analyser.joinable()) {
+            analyser.join();
+        }
+        ready = false;
+        cancelled = false;
+        cuts.clear();
+    }
+    
+    /**
+     * Open the cached index for 'videoFile'; if there is none and 'analyseIfMissing'
+     * is set, analyse the file in the background, mapping high-bit-depth
+     * frames at 'significantBits'. Never blocks on decoding.
+     */
+    void load(const std::string& videoFile, const std::vector<int>& keyframes, 
+              int frameCount, bool analyseIfMissing, int significantBits) {
+        cancel();
+        toneBits = significantBits;
+        FileStamp stamp = FileStamp::of(videoFile);
+        if (readIndex(indexPath(videoFile), stamp)) {
+            ready = true;
+            return;
+        }
+        if (!analyseIfMissing || frameCount <= 1) {
+            return;
+        }
+        
+        // A few segments per core, starting at keyframes so every task
+        // seeks exactly; without an index, evenly spaced backend seeks
+        totalFrames = frameCount;
+        analysedFrames = 0;
+        size_t segmentCount = std::max<size_t>(1, std::thread::hardware_concurrency() * 4);
+        std::vector<int> boundaries;
+        if (!keyframes.empty()) {
+            segmentCount = std::min(segmentCount, keyframes.size());
+            for (size_t i = 0; i < segmentCount; i++) {
+                boundaries.push_back(keyframes[i * keyframes.size() / segmentCount]);
+            }
+        } else {
+            segmentCount = std::min<size_t>(segmentCount, frameCount);
+            for (size_t i = 0; i < segmentCount; i++) {
+                boundaries.push_back(static_cast<int>(i * frameCount / segmentCount));
+            }
+        }
+        boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+        boundaries.front() = 0;
+        
+        analyser = std::thread(&SceneIndex::analyse, this, videoFile, stamp, boundaries);
+    }
+    
+    bool isReady() const {
+        return ready.load(std::memory_order_acquire);
+    }
+    
+    /**
+     * Analysis progress in percent
+     */
+    int progress() const {
+        return totalFrames > 0 ? static_cast<int>(100LL * analysedFrames / totalFrames) : 0;
+    }
+    
+    size_t sceneCount() const {
+        return isReady() ? cuts.size() + 1 : 0;
+    }
+    
+    /**
+     * Start of the next scene after 'frameNumber', or -1 in the last scene
+     */
+    int nextScene(int frameNumber) const {
+        auto it = std::upper_bound(cuts.begin(), cuts.end(), frameNumber);
+        return it == cuts.end() ? -1 : *it;
+    }
+    
+    /**
+     * Start of the scene before the one containing 'frameNumber', or of the
+     * current scene when 'frameNumber' is past its first frame (0 at most)
+     */
+    int previousScene(int frameNumber) const {
+        auto it = std::lower_bound(cuts.begin(), cuts.end(), frameNumber);
+        return it == cuts.begin() ? 0 : *(it - 1);
+    }
+};
+
+/**
+ * Bounded reorder buffer: items may be pushed out of order by workers and
+ * are popped strictly by sequence number. The producer reserves a sequence
+ * number first, which caps the items in flight at the queue capacity.
+ */
+template <typename T>
+class ReorderQueue {
+private:
+    std::map<size_t, T> items;
+    size_t nextSequence;
+    size_t capacity;
+    bool aborted;
+    std::mutex mutex;
+    std::condition_variable slotFree;
+    std::condition_variable itemReady;
+    
+public:
+    explicit ReorderQueue(size_t capacity) 
+        : nextSequence(0), capacity(capacity), aborted(false) {}
+    
+    /**
+     * Wait until 'sequence' lies within capacity of the next item to pop
+     */
+    bool waitForSlot(size_t sequence) {
+        std::unique_lock<std::mutex> lock(mutex);
+        slotFree.wait(lock, [&] { return aborted || sequence < nextSequence + capacity; });
+        return !aborted;
+    }
+    
+    void push(size_t sequence, T item) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            items.emplace(sequence, std::move(item));
+        }
+        itemReady.notify_all();
+    }
+    
+    /**
+     * Pop the item with the next sequence number, waiting for it to arrive
+     */
+    bool pop(T& item) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            itemReady.wait(lock, [&] { return aborted || items.count(nextSequence) > 0; });
+            if (aborted) {
+                return false;
+            }
+            auto it = items.find(nextSequence);
+            item = std::move(it->second);
+            items.erase(it);
+            nextSequence++;
+        }
+        slotFree.notify_all();
+        return true;
+    }
+    
+    void abort() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            aborted = true;
+        }
+        slotFree.notify_all();
+        itemReady.notify_all();
+    }
+};
+
+/**
+ * Frame-exact export of a frame range, either as numbered PNG/JPEG images
+ * or re-encoded into one clip. Decoding is sequential on the caller's
+ * thread; image encoding runs on a WorkStealingPool and a writer thread
+ * stores results in frame order through a bounded ReorderQueue, so
+ * throughput scales with cores while memory in flight stays bounded.
+ */
+class FrameExporter {
+private:
+    static constexpr size_t maxFramesInFlight = 32;
+    
+    struct Item {
+        cv::Mat frame;                // Clip mode: raw frame for VideoWriter
+        std::vector<uchar> encoded;   // Image mode: compressed file contents
+        int frameNumber = 0;
+        bool ok = true;
+    };
+    
+    static std::string lowercaseExtension(const std::string& path) {
+        std::string ext = std::filesystem::path(path).extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), 
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return ext;
+    }
+    
+    /**
+     * "out/shot.png" + 42 -> "out/shot_000043.png" (1-based like the UI)
+     */
+    static std::string imagePath(const std::string& output, int frameNumber) {
+        std::filesystem::path path(output);
+        char suffix[32];
+        std::snprintf(suffix, sizeof(suffix), "_%06d", frameNumber + 1);
+        return (path.parent_path() / (path.stem().string() + suffix + path.extension().string())).string();
+    }
+    
+public:
+    /**
+     * True if 'output' names an image sequence rather than a clip
+     */
+    static bool isImageOutput(const std::string& output) {
+        std::string ext = lowercaseExtension(output);
+        return ext == ".png" || ext == ".jpg" || ext == ".jpeg";
+    }
+    
+    /**
+     * Export frames [first, last] (0-based, inclusive) of 'videoFile'.
+     * '.png', '.jpg' or '.jpeg' outputs produce one numbered image per frame;
+     * anything else is written as a clip with cv::VideoWriter at 'fps'.
+     * Setting 'cancel' stops the export early.
+     */
+    static bool exportRange(const std::string& videoFile, int first, int last, 
+                            const std::string& output, double fps,
+                            const std::atomic<bool>* cancel = nullptr) {
+        cv::VideoCapture capture(videoFile);
+        if (!capture.isOpened() || first < 0 || last < first) {
+            std::cerr << "Export: cannot open " << videoFile << " or invalid range" << std::endl;
+            return false;
+        }
+        capture.set(cv::CAP_PROP_POS_FRAMES, first);
+        
+        bool images = isImageOutput(output);
+        std::string ext = lowercaseExtension(output);
+        std::vector<int> encodeParams;
+        if (ext == ".png") {
+            encodeParams = {cv::IMWRITE_PNG_COMPRESSION, 3};
+        } else if (images) {
+            encodeParams = {cv::IMWRITE_JPEG_QUALITY, 95};
+        }
+        
+        size_t count = static_cast<size_t>(last - first + 1);
+        ReorderQueue<Item> queue(maxFramesInFlight);
+        std::atomic<bool> failed(false);
+        size_t written = 0;
+        
+        // Writer: stores items in frame order, opening the clip on the first frame
+        std::thread writer([&] {
+            cv::VideoWriter clip;
+            Item item;
+            while (written < count && queue.pop(item)) {
+                bool ok = item.ok;
+                if (ok && images) {
+                    std::ofstream out(imagePath(output, item.frameNumber), std::ios::binary);
+                    out.write(reinterpret_cast<const char*>(item.encoded.data()), item.encoded.size());
+                    ok = static_cast<bool>(out);
+                } else if (ok) {
+                    if (!clip.isOpened()) {
+                        int fourcc = ext == ".avi" ? cv::VideoWriter::fourcc('M', 'J', 'P', 'G')
+                                                   : cv::VideoWriter::fourcc('m', 'p', '4', 'v');
+                        clip.open(output, fourcc, fps > 0.0 ? fps : 30.0, 
+                                  cv::Size(item.frame.cols, item.frame.rows));
+                    }
+                    ok = clip.isOpened();
+                    if (ok) {
+                        clip.write(item.frame);
+                    }
+                }
+                if (!ok) {
+                    failed = true;
+                    queue.abort();
+                    break;
+                }
+                written++;
+                if (written % 100 == 0 || written == count) {
+                    std::cout << "\rExport: " << written << "/" << count << " frames" << std::flush;
+                }
+            }
+        });
+        
+        {
+            WorkStealingPool pool;
+            for (size_t sequence = 0; sequence < count; sequence++) {
+                if ((cancel && *cancel) || !queue.waitForSlot(sequence)) {
+                    break;
+                }
+                Item item;
+                item.frameNumber = first + static_cast<int>(sequence);
+                if (!capture.read(item.frame)) {
+                    std::cerr << "\nExport: cannot decode frame " << (item.frameNumber + 1) << std::endl;
+                    failed = true;
+                    break;
+                }
+                
+                if (!images) {
+                    queue.push(sequence, std::move(item));
+                    continue;
+                }
+                
+                // One task per frame; the decoded Mat moves into the task
+                auto shared = std::make_shared<Item>(std::move(item));
+                pool.submit([&queue, &ext, &encodeParams, shared, sequence] {
+                    shared->ok = cv::imencode(ext, shared->frame, shared->encoded, encodeParams);
+                    shared->frame.release();
+                    queue.push(sequence, std::move(*shared));
+                });
+            }
+        } // Pool destructor waits for the queued encodes
+        
+        if (failed || (cancel && *cancel)) {
+            queue.abort();
+        }
+        writer.join();
+        std::cout << std::endl;
+        
+        bool ok = !failed && written == count;
+        std::cout << (ok ? "Exported " : "Export incomplete: ") << written << " frames to " 
+                  << output << std::endl;
+        return ok;
+    }
+};
+
+/**
+ * A playback control request, from a key or from the control socket
+ */
+struct PlayerCommand {
+    enum class Type { Play, Pause, TogglePause, Seek, Step, Speed, Quit };
+    
+    static constexpr double maxFrames = 1e9; // Seek and step values are clamped to fit an int
+    
+    Type type;
+    double value; // Seek: 0-based frame; Step: frames, negative backwards; Speed: rate
+    
+    /**
+     * Parse one line of the control protocol: play, pause, toggle,
+     * seek N (1-based like the on-screen counter), step [N], speed X, quit
+     */
+    static bool parse(const std::string& line, PlayerCommand& command) {
+        std::istringstream in(line);
+        std::string verb;
+        in >> verb;
+        double argument = 0.0;
+        bool hasArgument = static_cast<bool>(in >> argument);
+        if (hasArgument && !std::isfinite(argument)) {
+            return false;
+        }
+        in.clear();
+        std::string trailing;
+        if (in >> trailing) {
+            return false; // Extra or non-numeric arguments
+        }
+        
+        if (verb == "play" && !hasArgument) {
+            command = {Type::Play, 0.0};
+        } else if (verb == "pause" && !hasArgument) {
+            command = {Type::Pause, 0.0};
+        } else if (verb == "toggle" && !hasArgument) {
+            command = {Type::TogglePause, 0.0};
+        } else if (verb == "seek" && hasArgument && argument >= 1.0) {
+            command = {Type::Seek, std::min(std::floor(argument), maxFrames) - 1.0};
+        } else if (verb == "step") {
+            command = {Type::Step, hasArgument ? std::clamp(std::trunc(argument), -maxFrames, maxFrames) : 1.0};
+        } else if (verb == "speed" && hasArgument && argument > 0.0) {
+            command = {Type::Speed, argument};
+        } else if (verb == "quit" && !hasArgument) {
+            command = {Type::Quit, 0.0};
+        } else {
+            return false;
+        }
+        return true;
+    }
+};
+
+/**
+ * Lock-free multi-producer queue of player commands. Producers push onto
+ * an atomic stack; the playback loop takes the whole stack with a single
+ * exchange and restores submission order, so neither side ever waits.
+ */
+class CommandQueue {
+private:
+    struct Node {
+        PlayerCommand command;
+        Node* next;
+    };
+    
+    std::atomic<Node*> head;
+    
+public:
+    CommandQueue() : head(nullptr) {}
+    
+    ~CommandQueue() {
+        Node* node = head.exchange(nullptr);
+        while (node) {
+            Node* next = node->next;
+            delete node;
+            node = next;
+        }
+    }
+    
+    CommandQueue(const CommandQueue&) = delete;
+    CommandQueue& operator=(const CommandQueue&) = delete;
+    
+    /**
+     * Queue a command; callable from any thread
+     */
+    void push(const PlayerCommand& command) {
+        Node* node = new Node{command, head.load(std::memory_order_relaxed)};
+        while (!head.compare_exchange_weak(node->next, node, std::memory_order_release, 
+                                           std::memory_order_relaxed)) {
+        }
+    }
+    
+    /**
+     * Move everything queued into 'batch' in submission order. A seek
+     * supersedes every seek and step queued before it, so a burst of
+     * seeks (a scrubbing client) runs only the latest. False if empty.
+     */
+    bool drain(std::vector<PlayerCommand>& batch) {
+        batch.clear();
+        Node* node = head.exchange(nullptr, std::memory_order_acquire);
+        if (!node) {
+            return false;
+        }
+        while (node) {
+            batch.push_back(node->command);
+            Node* next = node->next;
+            delete node;
+            node = next;
+        }
+        std::reverse(batch.begin(), batch.end());
+        
+        auto lastSeek = std::find_if(batch.rbegin(), batch.rend(), [](const PlayerCommand& command) {
+            return command.type == PlayerCommand::Type::Seek;
+        });
+        if (lastSeek != batch.rend()) {
+            auto end = std::prev(lastSeek.base()); // The last seek itself stays
+            batch.erase(std::remove_if(batch.begin(), end, [](const PlayerCommand& command) {
+                return command.type == PlayerCommand::Type::Seek || 
+                       command.type == PlayerCommand::Type::Step;
+            }), end);
+        }
+        return true;
+    }
+};
+
+#ifdef _WIN32
+using SocketHandle = SOCKET;
+const SocketHandle invalidSocket = INVALID_SOCKET;
+const int sendFlags = 0;
+inline void closeSocket(SocketHandle socket) { closesocket(socket); }
+inline bool setNonBlocking(SocketHandle socket) {
+    u_long enabled = 1;
+    return ioctlsocket(socket, FIONBIO, &enabled) == 0;
+}
+inline bool lastCallWouldBlock() { return WSAGetLastError() == WSAEWOULDBLOCK; }
+#else
+using SocketHandle = int;
+const SocketHandle invalidSocket = -1;
+#ifdef MSG_NOSIGNAL
+const int sendFlags = MSG_NOSIGNAL; // A vanished peer must not raise SIGPIPE
+#else
+const int sendFlags = 0;            // SO_NOSIGPIPE is set on the socket instead
+#endif
+inline void closeSocket(SocketHandle socket) { close(socket); }
+inline bool setNonBlocking(SocketHandle socket) {
+#ifdef SO_NOSIGPIPE
+    int enabled = 1;
+    setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &enabled, sizeof(enabled));
+#endif
+    int flags = fcntl(socket, F_GETFL, 0);
+    return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+inline bool lastCallWouldBlock() { return errno == EAGAIN || errno == EWOULDBLOCK; }
+#endif
+
+/**
+ * Line-based TCP control front end on 127.0.0.1 (see PlayerCommand::parse
+ * for the protocol). One client at a time; a new connection replaces the
+ * old one. Each line is answered "ok" or "error". The server thread only
+ * pushes onto the CommandQueue, so a client never blocks presentation.
+ * Clients are non-blocking: a reply that does not fit the socket buffer
+ * of a client that stopped reading is dropped, so stop() never waits.
+ */
+class ControlServer {
+private:
+    static constexpr int pollMs = 100;           // select() timeout, bounds stop() latency
+    static constexpr size_t maxLineBytes = 4096; // Longer input is discarded
+    
+    CommandQueue& queue;
+    SocketHandle listener;
+    std::thread thread;
+    std::atomic<bool> stopping;
+    
+public:
+    explicit ControlServer(CommandQueue& target) 
+        : queue(target), listener(invalidSocket), stopping(false) {}
+    
+    ~ControlServer() {
+        stop();
+    }
+    
+    /**
+     * Listen on 127.0.0.1:'port' and serve on a background thread
+     */
+    bool start(int port) {
+#ifdef _WIN32
+        WSADATA wsaData;
+        if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+            return false;
+        }
+#endif
+        listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (listener == invalidSocket) {
+            return false;
+        }
+        int reuse = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || 
+            listen(listener, 1) != 0) {
+            closeSocket(listener);
+            listener = invalidSocket;
+            return false;
+        }
+        stopping = false;
+        thread = std::thread(&ControlServer::serveLoop, this);
+        return true;
+    }
+    
+    void stop() {
+        stopping = true;
+        if (thread.joinable()) {
+            thread.join();
+        }
+        if (listener != invalidSocket) {
+            closeSocket(listener);
+            listener = invalidSocket;
+#ifdef _WIN32
+            WSACleanup();
+#endif
+        }
+    }
+    
+private:
+    static void reply(SocketHandle client, const char* text) {
+        send(client, text, static_cast<int>(std::strlen(text)), sendFlags);
+    }
+    
+    void serveLoop() {
+        SocketHandle client = invalidSocket;
+        std::string pending;
+        char buffer[512];
+        
+        while (!stopping) {
+            fd_set readable;
+            FD_ZERO(&readable);
+            FD_SET(listener, &readable);
+            SocketHandle highest = listener;
+            if (client != invalidSocket) {
+                FD_SET(client, &readable);
+                highest = std::max(highest, client);
+            }
+            timeval timeout = {0, pollMs * 1000};
+            if (select(static_cast<int>(highest) + 1, &readable, nullptr, nullptr, &timeout) <= 0) {
+                continue;
+            }
+            
+            if (FD_ISSET(listener, &readable)) {
+                SocketHandle accepted = accept(listener, nullptr, nullptr);
+                if (accepted != invalidSocket && !setNonBlocking(accepted)) {
+                    closeSocket(accepted);
+                } else if (accepted != invalidSocket) {
+                    if (client != invalidSocket) {
+                        closeSocket(client);
+                    }
+                    client = accepted;
+                    pending.clear();
+                }
+                continue;
+            }
+            
+            int received = recv(client, buffer, sizeof(buffer), 0);
+            if (received < 0 && lastCallWouldBlock()) {
+                continue; // Spurious readiness
+            }
+            if (received <= 0) {
+                closeSocket(client);
+                client = invalidSocket;
+                continue;
+            }
+            pending.append(buffer, static_cast<size_t>(received));
+            
+            size_t lineEnd;
+            while ((lineEnd = pending.find('\n')) != std::string::npos) {
+                std::string line = pending.substr(0, lineEnd);
+                pending.erase(0, lineEnd + 1);
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+                PlayerCommand command;
+                if (PlayerCommand::parse(line, command)) {
+                    queue.push(command);
+                    reply(client, "ok\n");
+                } else {
+                    reply(client, "error: unknown command\n");
+                }
+            }
+            if (pending.size() > maxLineBytes) {
+                pending.clear();
+                reply(client, "error: line too long\n");
+            }
+        }
+        
+        if (client != invalidSocket) {
+            closeSocket(client);
+        }
+    }
+};
+
+/**
+ * Next playback speed up (direction > 0) or down from 'rate', clamped to
+ * the 0.25x-16x range
+ */
+double stepPlaybackRate(double rate, int direction) {
+    static const double rates[] = {0.25, 0.5, 1.0, 2.0, 4.0, 8.0, 16.0};
+    const int count = static_cast<int>(sizeof(rates) / sizeof(rates[0]));
+    int i = 0;
+    while (i < count - 1 && rates[i] < rate) {
+        i++;
+    }
+    return rates[std::clamp(i + (direction > 0 ? 1 : -1), 0, count - 1)];
+}
+
+class VideoPlayer {
+private:
+    static constexpr size_t decodeAheadFrames = 8;
+    static constexpr size_t reverseCacheBytes = 512u << 20;
+    static constexpr int prefetchFrames = 8; // From the typed target on
+    static constexpr int unindexedReverseFrames = 30; // Backward window without a keyframe index: a nominal GOP
+    static constexpr int fitInitialWidth = 1280; // Window size when --fit opens it
+    static constexpr int fitInitialHeight = 720;
+    static constexpr size_t defaultFrameCacheBytes = 256u << 20;
+    static constexpr uint64_t readaheadBytes = 8u << 20; // At 1x, scaled by the rate
+    static constexpr double audioResyncMs = 80.0; // Audio drift that restarts it at the video
+    static constexpr int stepSeekFrames = 8; // Longer steps seek to the target rather than decode each frame
+    static constexpr int commandPollMs = 20; // waitKey() timeout while paused with a control socket
+    static constexpr int seekPollMs = 5;     // ... and while an asynchronous seek is pending
+    static constexpr int seekTimeoutMs = 2000;
+    static constexpr int openPollMs = 15;    // ... while the file opens in the background
+    static constexpr int indexPollMs = 100;  // ... and while the keyframe scan runs
+    
+    // Mapped input: declared before 'cap', whose stream reader reads from it.
+    // Shared with the OpenedFile whose capture it feeds.
+    std::shared_ptr<MappedFile> inputMapping;
+    cv::VideoCapture cap;
+    cv::Mat currentFrame;
+    std::string windowName;
+    std::string videoPath;
+    bool verbose; // Print the load summary
+    bool headless; // Load for decoding only: no filmstrip, scenes or sidecar writes
+    DecodeBackend decodeBackend;
+    int hwDevice; // -1 lets the backend pick the device
+    bool mappedInput;
+    bool analyseScenes; // Run the scene-cut pass when no cached index exists
+    bool playAudio;
+    bool readaheadForward;   // Direction of the last readahead hint
+    uint64_t readaheadFrom;  // Position it was issued at
+    int totalFrames;
+    int currentFrameNumber;
+    double fps;
+    double currentPtsMs;
+    PlaybackScheduler scheduler;
+    AudioPlayer audio; // Master clock for the scheduler while it plays
+    
+    // Fast playback: the decode thread presents one frame in 'decodeStride'
+    // and skips the rest with grab() or, when scanning, keyframe jumps
+    double playbackRate;
+    std::atomic<int> decodeStride;
+    std::atomic<bool> keyframeScan;
+    
+    // OpenGL display: frames decoded through OpenCL interop stay in
+    // currentGpuFrame and are mapped into displayTexture without readback
+    bool useOpenGL;
+    bool gpuResidentFrames;  // Decode thread reads into cv::UMat slots
+    bool currentFrameOnGpu;  // currentGpuFrame, not currentFrame, is on screen
+    cv::UMat currentGpuFrame;
+    cv::ogl::Texture2D displayTexture;
+    
+    // Frame counter overlay, drawn in place and undone after imshow()
+    cv::Rect overlayRect;   // Region the text can cover
+    cv::Mat overlayRegion;  // View of currentFrame at overlayRect
+    cv::Mat overlayBackup;  // Pixels under overlayRect, reused every frame
+    std::string overlayText; // Reused so formatting does not allocate
+    bool showHud;            // Stats line under the frame counter
+    std::string hudText;
+    PipelineStats stats;
+    FrameFilter filter;      // Applied by whichever thread decodes, before caching
+    
+    // Native frames (opt-in): frames going into the LRU and reverse caches
+    // are packed to I420 after filtering and converted back (and scaled)
+    // only when presented, by presentable(). The ring stays BGR.
+    bool nativeFrames;       // Cache frames as I420 from loadVideo() on
+    YuvConverter yuv;
+    cv::Mat packScratch;     // Decoded BGR frame on its way into the reverse cache
+    cv::Mat rememberScratch; // Packed copy of the frame on screen
+    ToneMapper toneMapper;   // 10/16-bit frames likewise go to 8-bit BGR on present
+    cv::Mat presentScratch;  // Conversion output, swapped with currentFrame
+    
+    // Fit-to-window: frames are scaled once, right after decode, to the
+    // window size, so the ring, caches and display all move the small frame
+    bool fitToWindow;
+    cv::Size nativeSize;
+    cv::Size decodeSize;     // Empty: keep the native resolution
+    cv::Mat decodeScratch;   // Full-size decoder output, reused
+    cv::UMat decodeScratchGpu;
+    
+    KeyframeIndex keyframeIndex;
+    Filmstrip filmstrip;
+    SceneIndex sceneIndex;
+    bool showFilmstrip;
+    int timelineClickFrame; // Set by the filmstrip mouse callback, -1 if none
+    FrameRangeCache reverseCache;
+    FrameCache frameCache;
+    
+    // Go-to-frame entry typed into the window. While the user types, the
+    // prefetch thread decodes from the number so far into frameCache on its
+    // own capture; prefetchMutex also guards the filter and decodeSize
+    // against changes while it scales and filters.
+    bool enteringFrame;
+    std::string frameEntry;
+    cv::VideoCapture prefetchCap; // Owned by prefetchThread
+    std::thread prefetchThread;
+    std::mutex prefetchMutex;
+    std::condition_variable prefetchWake;
+    int prefetchRequest; // First frame to prefetch, -1 if none pending
+    // One-slot handoff of the beginSeek() target, also under prefetchMutex:
+    // the prefetch thread leaves the frame here whether or not the LRU
+    // cache can keep it (a budget under one frame, or evicted meanwhile)
+    int seekHandoffFrame; // Frame wanted, -1 if none
+    bool seekHandoffReady;
+    cv::Mat seekHandoffImage;
+    double seekHandoffPtsMs;
+    bool prefetchStop;
+    
+    // Range export ('I'/'O' mark, 'X' exports in the background)
+    int exportIn;
+    int exportOut;
+    std::thread exportThread;
+    std::atomic<bool> exportRunning;
+    std::atomic<bool> exportCancel;
+    
+    // Remote control: any thread posts, the playback loop drains
+    CommandQueue commands;
+    std::vector<PlayerCommand> commandBatch; // Reused by every drain
+    int controlPort; // 0: no control socket
+    std::unique_ptr<ControlServer> controlServer; // Declared after 'commands', which it feeds
+    
+    // Decode-ahead: while running, 'cap' is owned by decodeThread
+    FrameRingBuffer frameQueue;
+    std::thread decodeThread;
+    WorkStealingPool* decodePool; // Shared pool replacing decodeThread if set
+    std::mutex decodeTaskMutex;
+    std::condition_variable decodeTaskDone;
+    bool decodeAheadActive;
+    bool decodeTaskScheduled;
+    int decodePosition; // Frame number the next cap.read() will return
+    int queuedPosition; // Frame number the next frameQueue.pop() will return
+    int decodeResumeAt; // If >= 0, the decode thread first positions 'cap' here
+    std::atomic<bool> decodeCancel; // Abandon that positioning (stopDecodeAhead())
+    
+    // Asynchronous seek: the prefetch thread decodes the target while a
+    // stand-in frame is shown
+    int pendingSeek; // -1 if none
+    std::chrono::steady_clock::time_point pendingSeekSince;
+    
+    /**
+     * One file being opened, and everything opening it produces. openFile()
+     * touches nothing else, so an open the user stopped waiting for can run
+     * to its end on its own after the player is gone; adoptOpenedFile()
+     * moves the result into the player.
+     */
+    struct OpenedFile {
+        std::string path;
+        std::vector<int> decoderParams; // Empty for software decoding
+        std::chrono::steady_clock::time_point loadStart;
+        std::shared_ptr<MappedFile> mapping; // Before 'cap', whose stream reader reads from it
+        cv::VideoCapture cap;
+        cv::Mat firstFrame;
+        FileStamp stamp;
+        KeyframeIndex index;
+        KeyframeIndex::StreamInfo streamInfo;
+        bool indexFromSidecar = false;
+        int totalFrames = 0;
+        double fps = 0.0;
+        double openMs = -1.0;
+        double firstFrameMs = -1.0;
+        std::atomic<bool> finished{false};
+        bool succeeded = false; // Valid once 'finished'
+        
+        double msSinceLoadStart() const {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+        }
+    };
+    
+    // Asynchronous open: loadVideoAsync() opens 'opening' on 'opener'
+    // while startPlayback() already shows the window. The keyframe scan
+    // then runs on 'indexer' into scannedIndex, which the playback loop
+    // adopts when it finishes.
+    std::thread opener;
+    std::shared_ptr<OpenedFile> opening;
+    bool openAbandoned; // Quit while 'opener' still ran; it was detached
+    std::thread indexer;
+    std::atomic<bool> indexFinished;
+    std::atomic<bool> indexCancel;
+    KeyframeIndex scannedIndex; // Owned by 'indexer' until indexFinished
+    bool scannedIndexOk;
+    bool indexLoadsDeferred;    // Filmstrip and scene index wait for the scan
+    
+    // Load state carried between the phases, and the startup metrics:
+    // times since loadVideo() began
+    FileStamp loadStamp;
+    KeyframeIndex::StreamInfo loadStreamInfo;
+    bool indexFromSidecar;
+    std::chrono::steady_clock::time_point loadStart;
+    double openMs;       // Capture opened and pixel layout negotiated
+    double firstFrameMs; // First frame decoded
+    double firstShownMs; // First frame on screen; -1 until then
+    
+    /**
+     * Producer loop: decode sequentially into free ring slots
+     */
+    void decodeLoop() {
+        if (!resumeDecodePosition()) {
+            frameQueue.close();
+            return;
+        }
+        while (FrameRingBuffer::Slot* slot = frameQueue.beginWrite()) {
+            if (!decodeInto(*slot)) {
+                break;
+            }
+        }
+    }
+    
+    /**
+     * Move 'cap' to decodeResumeAt if startDecodeAheadAt() asked for it,
+     * on the decoding thread so the caller does not wait on the GOP decode
+     */
+    bool resumeDecodePosition() {
+        if (decodeResumeAt < 0) {
+            return true;
+        }
+        int target = decodeResumeAt;
+        decodeResumeAt = -1;
+        ScopedStageTimer timer(stats.decode);
+        return positionCapture(target, &decodeCancel);
+    }
+    
+    /**
+     * Decode the next frame into a ring slot and publish it; closes the
+     * ring at end of stream
+     */
+    bool decodeInto(FrameRingBuffer::Slot& slot) {
+        bool ok;
+        {
+            ScopedStageTimer timer(stats.decode);
+            ok = cap.grab();
+        }
+        if (ok) {
+            ScopedStageTimer timer(stats.convert);
+            if (gpuResidentFrames) {
+                ok = retrieveScaled(slot.gpuImage, decodeScratchGpu);
+                if (ok) {
+                    filter.apply(slot.gpuImage);
+                }
+            } else {
+                ok = retrieveScaled(slot.image, decodeScratch);
+                if (ok) {
+                    applyFilter(slot.image);
+                }
+            }
+        }
+        if (!ok) {
+            frameQueue.close(); // End of stream
+            return false;
+        }
+        frameQueue.commitWrite(decodePosition, framePts(decodePosition));
+        decodePosition++;
+        if (decodeStride > 1 && !skipAhead()) {
+            frameQueue.close(); // End of stream
+            return false;
+        }
+        return true;
+    }
+    
+    /**
+     * Fast playback: move 'cap' to the next frame worth presenting. Without
+     * an index the skipped frames are only grab()bed; with one,
+     * positionCapture() jumps to a keyframe whenever that is cheaper, and
+     * keyframe scanning lands on keyframes only, so a GOP costs one decode.
+     */
+    bool skipAhead() {
+        int target = decodePosition + decodeStride - 1;
+        ScopedStageTimer timer(stats.decode);
+        if (keyframeIndex.empty()) {
+            while (decodePosition < target && cap.grab()) {
+                decodePosition++;
+            }
+            return decodePosition == target;
+        }
+        if (keyframeScan) {
+            int keyframe = keyframeIndex.keyframeAtOrAfter(target);
+            target = keyframe >= 0 ? keyframe : target;
+        }
+        return positionCapture(target);
+    }
+    
+    /**
+     * Retrieve the grabbed frame into 'frame' at decodeSize. The decoder
+     * writes into 'scratch' and the result is downscaled once; if the
+     * backend already delivers decodeSize the buffers are just swapped.
+     */
+    template <typename MatType>
+    bool retrieveScaled(MatType& frame, MatType& scratch) {
+        if (decodeSize.empty()) {
+            return cap.retrieve(frame);
+        }
+        if (!cap.retrieve(scratch)) {
+            return false;
+        }
+        if (scratch.size() == decodeSize) {
+            cv::swap(scratch, frame);
+        } else {
+            cv::resize(scratch, frame, decodeSize, 0, 0, cv::INTER_AREA);
+        }
+        return true;
+    }
+    
+    bool readScaled(cv::Mat& frame) {
+        return cap.grab() && retrieveScaled(frame, decodeScratch);
+    }
+    
+    /**
+     * Filter a decoded frame; high-bit-depth frames are filtered after
+     * tone mapping. Frames are packed for a cache only after this.
+     */
+    void applyFilter(cv::Mat& frame) const {
+        if (!yuv.isNative(frame) && !ToneMapper::needsMapping(frame)) {
+            filter.apply(frame);
+        }
+    }
+    
+    /**
+     * Convert currentFrame for display if it came packed from a cache
+     * (unpacked and scaled to decodeSize; it was filtered before packing)
+     * or is high bit depth (tone mapped, then filtered). Frames that are
+     * dropped or only cached never get here.
+     */
+    void presentable() {
+        bool native = yuv.isNative(currentFrame);
+        if (!native && !ToneMapper::needsMapping(currentFrame)) {
+            return;
+        }
+        ScopedStageTimer timer(stats.convert);
+        if (native) {
+            yuv.toBgr(currentFrame, presentScratch, decodeSize);
+            cv::swap(currentFrame, presentScratch);
+            return;
+        }
+        toneMapper.apply(currentFrame, presentScratch);
+        cv::swap(currentFrame, presentScratch);
+        filter.apply(currentFrame);
+    }
+    
+    /**
+     * Cache frames as I420 if asked to; the GPU display uploads or maps BGR
+     */
+    void selectPixelLayout() {
+        yuv.setLayout(nativeFrames && !useOpenGL ? PixelLayout::I420 : PixelLayout::BGR);
+    }
+    
+    /**
+     * Pool variant of decodeLoop(): fill the free slots without blocking a
+     * shared worker, then return. The consumer reschedules after each pop.
+     */
+    void decodeTask() {
+        if (!resumeDecodePosition()) {
+            frameQueue.close(); // The retire check below then ends the task
+        }
+        while (true) {
+            while (FrameRingBuffer::Slot* slot = frameQueue.tryBeginWrite()) {
+                if (!decodeInto(*slot)) {
+                    break;
+                }
+            }
+            
+            // A slot may have been freed after the last tryBeginWrite() while
+            // the consumer still saw this task as scheduled, so re-check
+            // under the lock before retiring
+            std::lock_guard<std::mutex> lock(decodeTaskMutex);
+            if (decodeAheadActive && frameQueue.hasFreeSlot()) {
+                continue;
+            }
+            decodeTaskScheduled = false;
+            decodeTaskDone.notify_all();
+            return;
+        }
+    }
+    
+    /**
+     * Queue decodeTask() on the shared pool unless one is already pending
+     */
+    void scheduleDecodeTask() {
+        std::lock_guard<std::mutex> lock(decodeTaskMutex);
+        if (!decodePool || !decodeAheadActive || decodeTaskScheduled) {
+            return;
+        }
+        decodeTaskScheduled = true;
+        decodePool->submit([this] { decodeTask(); });
+    }
+    
+    /**
+     * OpenCV acceleration type requested for the configured backend
+     */
+    cv::VideoAccelerationType accelerationType() const {
+        switch (decodeBackend) {
+            case DecodeBackend::AnyHardware: return cv::VIDEO_ACCELERATION_ANY;
+            case DecodeBackend::VAAPI:       return cv::VIDEO_ACCELERATION_VAAPI;
+            case DecodeBackend::D3D11:       return cv::VIDEO_ACCELERATION_D3D11;
+            case DecodeBackend::MFX:         return cv::VIDEO_ACCELERATION_MFX;
+            default:                         return cv::VIDEO_ACCELERATION_NONE;
+        }
+    }
+    
+    /**
+     * Capture parameters for the configured hardware decoder, none for
+     * software decoding
+     */
+    std::vector<int> decoderParams() const {
+        if (decodeBackend == DecodeBackend::Software) {
+            return {};
+        }
+        return {
+            cv::CAP_PROP_HW_ACCELERATION, accelerationType(),
+            cv::CAP_PROP_HW_DEVICE, hwDevice,
+            cv::CAP_PROP_HW_ACCELERATION_USE_OPENCL, useOpenGL ? 1 : 0
+        };
+    }
+    
+    /**
+     * Open 'file' with its hardware decoder, falling back to software
+     * decoding if the backend or device refuses it
+     */
+    static bool openCapture(OpenedFile& file) {
+        if (!file.decoderParams.empty()) {
+            if (openSource(file, file.decoderParams)) {
+                return true;
+            }
+            std::cerr << "Warning: Hardware decoding unavailable, using software decoding" << std::endl;
+        }
+        return openSource(file, {});
+    }
+    
+    /**
+     * Open through the mapped stream reader when there is one (OpenCV
+     * 4.11+), otherwise by path; the mapping then only serves readahead
+     */
+    static bool openSource(OpenedFile& file, const std::vector<int>& params) {
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 11)
+        if (file.mapping->data() && 
+            file.cap.open(cv::makePtr<MappedStreamReader>(*file.mapping), cv::CAP_FFMPEG, params)) {
+            return true;
+        }
+#endif
+        return params.empty() ? file.cap.open(file.path) : file.cap.open(file.path, cv::CAP_ANY, params);
+    }
+    
+    /**
+     * Approximate byte offset of 'frameNumber': its keyframe's offset from
+     * the index when known, otherwise proportional to the frame number
+     */
+    uint64_t estimateByteOffset(int frameNumber) const {
+        int64_t offset = keyframeIndex.byteOffsetOf(frameNumber);
+        if (offset >= 0) {
+            return static_cast<uint64_t>(offset);
+        }
+        if (totalFrames <= 0 || frameNumber <= 0) {
+            return 0;
+        }
+        return static_cast<uint64_t>(static_cast<double>(inputMapping->size()) * frameNumber / totalFrames);
+    }
+    
+    /**
+     * Before a seek: have the OS fetch the byte range of the GOP holding
+     * 'frameNumber', so decoding from its keyframe does not wait on I/O
+     */
+    void prefetchGop(int frameNumber) {
+        if (!inputMapping->data()) {
+            return;
+        }
+        int nextKeyframe = keyframeIndex.keyframeAtOrAfter(frameNumber + 1);
+        uint64_t start = estimateByteOffset(frameNumber);
+        uint64_t end = estimateByteOffset(nextKeyframe > 0 ? nextKeyframe : frameNumber + 1);
+        inputMapping->willNeed(start, std::max(end, start) - start + 2 * KeyframeIndex::demuxSlackBytes);
+    }
+    
+    /**
+     * Keep the OS reading ahead of playback in its current direction, with
+     * a window that grows with the playback rate. Re-issued once playback
+     * has moved half a window, or when the direction changes.
+     */
+    void adviseReadahead(bool forward) {
+        if (!inputMapping->data()) {
+            return;
+        }
+        uint64_t window = static_cast<uint64_t>(readaheadBytes * std::max(1.0, playbackRate));
+        uint64_t position = estimateByteOffset(currentFrameNumber);
+        uint64_t moved = position > readaheadFrom ? position - readaheadFrom : readaheadFrom - position;
+        if (forward == readaheadForward && moved < window / 2) {
+            return;
+        }
+        if (forward != readaheadForward) {
+            inputMapping->setSequential(forward);
+            readaheadForward = forward;
+        }
+        readaheadFrom = position;
+        if (forward) {
+            inputMapping->willNeed(position, window);
+        } else {
+            uint64_t start = position > window ? position - window : 0;
+            inputMapping->willNeed(start, position - start + 2 * KeyframeIndex::demuxSlackBytes);
+        }
+    }
+    
+    /**
+     * Create the OpenGL window and bind an OpenCL context to its GL context.
+     * This must happen before the capture is opened so that hardware
+     * decoding shares that context. Falls back to the regular window if
+     * OpenCV was built without OpenGL or OpenCL/GL sharing.
+     */
+    void initOpenGLDisplay() {
+        try {
+            cv::namedWindow(windowName, cv::WINDOW_OPENGL | windowFlags());
+            cv::setOpenGlContext(windowName);
+            cv::ogl::ocl::initializeContextFromGL();
+        } catch (const cv::Exception& e) {
+            std::cerr << "Warning: OpenGL display unavailable, using regular window: " 
+                      << e.what() << std::endl;
+            cv::destroyWindow(windowName);
+            useOpenGL = false;
+        }
+    }
+    
+    /**
+     * Present the current frame through the OpenGL texture. GPU-resident
+     * frames are converted into the texture by OpenCL/GL interop; host frames
+     * are uploaded. The frame counter goes into the window title, since
+     * drawing it would need the pixels on the host.
+     */
+    void displayFrameOpenGL() {
+        if (currentFrameOnGpu) {
+            cv::ogl::convertToGLTexture2D(currentGpuFrame, displayTexture);
+        } else {
+            displayTexture.copyFrom(currentFrame);
+        }
+        cv::setWindowTitle(windowName, showHud ? overlayText + "  " + hudText : overlayText);
+        ScopedStageTimer timer(stats.show);
+        cv::imshow(windowName, displayTexture);
+    }
+    
+    /**
+     * Human-readable decoder description for the load summary
+     */
+    std::string describeDecoder() const {
+        std::string accel;
+        switch (static_cast<int>(cap.get(cv::CAP_PROP_HW_ACCELERATION))) {
+            case cv::VIDEO_ACCELERATION_D3D11: accel = "hardware D3D11"; break;
+            case cv::VIDEO_ACCELERATION_VAAPI: accel = "hardware VAAPI"; break;
+            case cv::VIDEO_ACCELERATION_MFX:   accel = "hardware MFX"; break;
+            case cv::VIDEO_ACCELERATION_NONE:  accel = "software"; break;
+            default:                           accel = "hardware"; break;
+        }
+        return cap.getBackendName() + " (" + accel + ")";
+    }
+    
+    /**
+     * Nominal duration of one frame in milliseconds
+     */
+    double frameDurationMs() const {
+        return 1000.0 / (fps > 0.0 ? fps : 30.0);
+    }
+    
+    /**
+     * Timestamp of a frame: from the index when available, otherwise from the
+     * frame just read from 'cap', falling back to the nominal frame rate
+     */
+    double framePts(int frameNumber) const {
+        double ptsMs = keyframeIndex.ptsOf(frameNumber);
+        if (ptsMs >= 0.0) {
+            return ptsMs;
+        }
+        ptsMs = cap.get(cv::CAP_PROP_POS_MSEC);
+        if (ptsMs <= 0.0 && frameNumber > 0) {
+            ptsMs = frameNumber * frameDurationMs();
+        }
+        return ptsMs;
+    }
+    
+    /**
+     * Media time one presented frame covers while frames are being skipped
+     */
+    double presentedIntervalMs() const {
+        return frameDurationMs() * decodeStride;
+    }
+    
+    /**
+     * Advance to the frame that is due now, dropping any whose display
+     * interval has already passed so playback never falls behind the clock
+     */
+    bool advanceOnSchedule() {
+        if (!stepForward(false)) {
+            return false;
+        }
+        while (scheduler.isLate(currentPtsMs, presentedIntervalMs())) {
+            if (!stepForward(false)) {
+                break; // Keep the last frame on screen
+            }
+            scheduler.countDroppedFrame();
+        }
+        return true;
+    }
+    
+    /**
+     * Start decoding ahead from the current capture position
+     */
+    void startDecodeAhead() {
+        frameQueue.reset();
+        queuedPosition = decodeResumeAt >= 0 ? decodeResumeAt : decodePosition;
+        if (decodePool) {
+            {
+                std::lock_guard<std::mutex> lock(decodeTaskMutex);
+                decodeAheadActive = true;
+            }
+            scheduleDecodeTask();
+        } else {
+            decodeThread = std::thread(&VideoPlayer::decodeLoop, this);
+        }
+    }
+    
+    /**
+     * Stop the decode thread (or wait out the pool task) so 'cap' can be
+     * used directly (seeking)
+     */
+    void stopDecodeAhead() {
+        decodeCancel = true;
+        if (decodeThread.joinable()) {
+            frameQueue.close();
+            decodeThread.join();
+        }
+        
+        {
+            std::unique_lock<std::mutex> lock(decodeTaskMutex);
+            if (decodeAheadActive) {
+                decodeAheadActive = false;
+                frameQueue.close();
+                decodeTaskDone.wait(lock, [this] { return !decodeTaskScheduled; });
+            }
+        }
+        decodeCancel = false;
+        decodeResumeAt = -1;
+    }
+    
+    /**
+     * Restart decoding ahead from 'frameNumber'. The decode thread
+     * positions the capture itself, so this returns at once; stopping it
+     * meanwhile abandons the positioning.
+     */
+    void startDecodeAheadAt(int frameNumber) {
+        stopDecodeAhead();
+        decodeResumeAt = frameNumber;
+        startDecodeAhead();
+    }
+    
+    /**
+     * Position 'cap' so the next read returns 'frameNumber', with as little
+     * decoding as the keyframe index allows: keep rolling forward if no
+     * keyframe lies between the capture position and the target, otherwise
+     * jump to the target's keyframe, and skip intermediate frames with grab()
+     * (no colour conversion).
+     * Must only be called by the owner of 'cap': the decode thread while it
+     * runs, anyone else while it is stopped. Gives up when '*cancel' is set.
+     */
+    bool positionCapture(int frameNumber, const std::atomic<bool>* cancel = nullptr) {
+        int keyframe = keyframeIndex.keyframeAtOrBefore(frameNumber);
+        
+        if (keyframe < 0) {
+            // No index: let the backend find the keyframe itself
+            if (decodePosition != frameNumber) {
+                prefetchGop(frameNumber);
+                cap.set(cv::CAP_PROP_POS_FRAMES, frameNumber);
+                decodePosition = frameNumber;
+            }
+        } else if (decodePosition > frameNumber || keyframe > decodePosition) {
+            prefetchGop(frameNumber);
+            cap.set(cv::CAP_PROP_POS_FRAMES, keyframe);
+            decodePosition = keyframe;
+        }
+        
+        while (decodePosition < frameNumber && !(cancel && *cancel) && cap.grab()) {
+            decodePosition++;
+        }
+        return decodePosition == frameNumber;
+    }
+    
+    /**
+     * Decode 'frameNumber' synchronously into currentFrame.
+     * Must only be called while the decode thread is stopped.
+     */
+    bool readFrameAt(int frameNumber) {
+        if (positionCapture(frameNumber) && readScaled(currentFrame)) {
+            applyFilter(currentFrame);
+            currentFrameNumber = frameNumber;
+            currentPtsMs = framePts(frameNumber);
+            currentFrameOnGpu = false;
+            decodePosition = frameNumber + 1;
+            return true;
+        }
+        decodePosition = static_cast<int>(cap.get(cv::CAP_PROP_POS_FRAMES));
+        return false;
+    }
+    
+    /**
+     * Decode forward from the keyframe of 'frameNumber' up to and including
+     * it, keeping the last reverseCache.capacity() frames (at most
+     * unindexedReverseFrames without a keyframe index) so the following
+     * backward steps are served without touching 'cap'.
+     * Must only be called while the decode thread is stopped.
+     */
+    bool fillReverseCache(int frameNumber) {
+        // Without an index the GOP start is unknown: decode a bounded window
+        // rather than the whole cache capacity on one keypress
+        int window = static_cast<int>(reverseCache.capacity());
+        if (keyframeIndex.empty()) {
+            window = std::min(window, unindexedReverseFrames);
+        }
+        int first = std::max({0, frameNumber - window + 1,
+                              keyframeIndex.keyframeAtOrBefore(frameNumber)});
+        
+        reverseCache.clear();
+        if (!positionCapture(first)) {
+            return false;
+        }
+        
+        reverseCache.beginFill(first);
+        bool pack = yuv.getLayout() == PixelLayout::I420;
+        while (decodePosition <= frameNumber) {
+            cv::Mat& slot = reverseCache.nextSlot();
+            cv::Mat& decoded = pack ? packScratch : slot;
+            if (!readScaled(decoded)) {
+                break;
+            }
+            applyFilter(decoded);
+            if (pack) {
+                yuv.pack(decoded, slot);
+            }
+            reverseCache.commitFill(framePts(decodePosition));
+            decodePosition++;
+        }
+        return reverseCache.contains(frameNumber);
+    }
+    
+    /**
+     * Present 'frameNumber' from the reverse or LRU cache if either holds
+     * it. The reverse run is checked first, so the LRU counts a miss only
+     * when neither cache has the frame.
+     */
+    bool showCachedFrame(int frameNumber) {
+        if (showReverseCachedFrame(frameNumber)) {
+            return true;
+        }
+        double ptsMs;
+        if (frameCache.lookup(frameNumber, currentFrame, ptsMs)) {
+            currentFrameNumber = frameNumber;
+            currentPtsMs = ptsMs;
+            currentFrameOnGpu = false;
+            return true;
+        }
+        return false;
+    }
+    
+    bool showReverseCachedFrame(int frameNumber) {
+        if (!reverseCache.contains(frameNumber)) {
+            return false;
+        }
+        reverseCache.frame(frameNumber).copyTo(currentFrame);
+        currentFrameNumber = frameNumber;
+        currentPtsMs = reverseCache.pts(frameNumber);
+        currentFrameOnGpu = false;
+        return true;
+    }
+    
+    /**
+     * Size the overlay region for the widest possible frame counter
+     */
+    void updateOverlayGeometry() {
+        std::string widest = "Frame: " + std::string(std::to_string(totalFrames).size(), '8') + 
+                             "/" + std::to_string(totalFrames);
+        int baseline = 0;
+        cv::Size textSize = cv::getTextSize(widest, cv::FONT_HERSHEY_SIMPLEX, 1, 2, &baseline);
+        
+        // Text origin is (10, 30); pad for stroke thickness and anti-aliasing
+        cv::Rect textRect(6, 30 - textSize.height - 4, 
+                          textSize.width + 8, textSize.height + baseline + 8);
+        
+        if (showHud) {
+            // HUD line at (10, 60), sized for the widest values it can show
+            hudText = "decode 9999.9 ms  convert 9999.9 ms  present 9999.9 ms  queue 88/88  dropped 88888888";
+            cv::Size hudSize = cv::getTextSize(hudText, cv::FONT_HERSHEY_SIMPLEX, 0.6, 1, &baseline);
+            textRect |= cv::Rect(6, 60 - hudSize.height - 4, 
+                                 hudSize.width + 8, hudSize.height + baseline + 8);
+            hudText.clear();
+        }
+        
+        overlayRect = textRect & cv::Rect(0, 0, currentFrame.cols, currentFrame.rows);
+        overlayText.reserve(widest.size());
+    }
+    
+    /**
+     * Format the frame counter into the reused overlayText buffer
+     */
+    void formatOverlayText() {
+        char info[64];
+        if (enteringFrame) {
+            // Narrower than the counter, whose two numbers take twice the
+            // digits an entry may have (a shared multi-stream entry can
+            // exceed that only on a stream of a few frames)
+            std::snprintf(info, sizeof(info), "Go to: %s_", frameEntry.c_str());
+        } else {
+            std::snprintf(info, sizeof(info), "Frame: %d/%d", currentFrameNumber + 1, totalFrames);
+        }
+        overlayText.assign(info);
+        
+        if (showHud) {
+            char hud[128];
+            std::snprintf(hud, sizeof(hud), 
+                          "decode %.1f ms  convert %.1f ms  present %.1f ms  queue %d/%d  dropped %d",
+                          stats.decode.lastMs(), stats.convert.lastMs(), 
+                          stats.overlay.lastMs() + stats.show.lastMs(),
+                          static_cast<int>(frameQueue.size()), static_cast<int>(decodeAheadFrames),
+                          scheduler.getDroppedFrames());
+            hudText.assign(hud);
+        }
+    }
+    
+    /**
+     * Draw the frame counter onto currentFrame, saving the pixels it covers
+     */
+    void drawOverlay() {
+        overlayRegion = currentFrame(overlayRect);
+        overlayRegion.copyTo(overlayBackup);
+        cv::putText(currentFrame, overlayText, cv::Point(10, 30), 
+                   cv::FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(0, 255, 0), 2);
+        if (showHud) {
+            cv::putText(currentFrame, hudText, cv::Point(10, 60), 
+                       cv::FONT_HERSHEY_SIMPLEX, 0.6, cv::Scalar(0, 255, 0), 1);
+        }
+    }
+    
+    /**
+     * Undo drawOverlay() so cached and reused buffers keep clean pixels
+     */
+    void restoreOverlay() {
+        overlayBackup.copyTo(overlayRegion);
+    }
+    
+    static std::string sidecarPath(const std::string& videoFile) {
+        return videoFile + ".vpidx";
+    }
+    
+    /**
+     * Export the marked range as PNG images next to the video without
+     * blocking playback
+     */
+    void startExport() {
+        if (exportRunning) {
+            std::cout << "\nExport already running" << std::endl;
+            return;
+        }
+        if (exportThread.joinable()) {
+            exportThread.join();
+        }
+        int first = std::min(exportIn, exportOut);
+        int last = std::max(exportIn, exportOut);
+        std::string output = videoPath + "_export.png";
+        std::cout << "\nExporting frames " << (first + 1) << "-" << (last + 1) 
+                  << " to " << output << std::endl;
+        
+        exportRunning = true;
+        exportCancel = false;
+        exportThread = std::thread([this, first, last, output] {
+            FrameExporter::exportRange(videoPath, first, last, output, fps, &exportCancel);
+            exportRunning = false;
+        });
+    }
+    
+    /**
+     * Ask the prefetch thread to decode from 'frameNumber' on, superseding
+     * any request it is still working on. Never blocks on decoding.
+     */
+    void requestPrefetch(int frameNumber) {
+        {
+            std::lock_guard<std::mutex> lock(prefetchMutex);
+            prefetchRequest = frameNumber;
+            if (!prefetchThread.joinable()) {
+                prefetchStop = false;
+                prefetchThread = std::thread(&VideoPlayer::prefetchLoop, this);
+            }
+        }
+        prefetchWake.notify_one();
+    }
+    
+    void stopPrefetch() {
+        {
+            std::lock_guard<std::mutex> lock(prefetchMutex);
+            prefetchStop = true;
+        }
+        prefetchWake.notify_one();
+        if (prefetchThread.joinable()) {
+            prefetchThread.join();
+        }
+        prefetchCap.release();
+        prefetchRequest = -1;
+    }
+    
+    void prefetchLoop() {
+        std::unique_lock<std::mutex> lock(prefetchMutex);
+        while (true) {
+            prefetchWake.wait(lock, [this] { return prefetchStop || prefetchRequest >= 0; });
+            if (prefetchStop) {
+                return;
+            }
+            int first = prefetchRequest;
+            prefetchRequest = -1;
+            lock.unlock();
+            prefetchFrom(first);
+            lock.lock();
+        }
+    }
+    
+    /**
+     * Decode [first, first + prefetchFrames) on prefetchCap, starting at the
+     * keyframe, and cache the frames exactly as the decode stage would
+     * produce them. Gives up as soon as a newer request arrives.
+     */
+    void prefetchFrom(int first) {
+        if (!prefetchCap.isOpened() && !prefetchCap.open(videoPath)) {
+            return;
+        }
+        int last = std::min(first + prefetchFrames, totalFrames) - 1;
+        int keyframe = keyframeIndex.keyframeAtOrBefore(first);
+        int position = keyframe >= 0 ? keyframe : first;
+        prefetchCap.set(cv::CAP_PROP_POS_FRAMES, position);
+        
+        cv::Mat decoded, scaled, packed;
+        for (; position <= last; position++) {
+            int wanted;
+            {
+                std::lock_guard<std::mutex> lock(prefetchMutex);
+                if (prefetchStop || prefetchRequest >= 0) {
+                    return; // Superseded
+                }
+                wanted = seekHandoffReady ? -1 : seekHandoffFrame;
+            }
+            if (!prefetchCap.grab()) {
+                return;
+            }
+            if (position < first || (position != wanted && frameCache.contains(position))) {
+                continue;
+            }
+            if (!prefetchCap.retrieve(decoded)) {
+                return;
+            }
+            double ptsMs = keyframeIndex.ptsOf(position);
+            if (ptsMs < 0.0) {
+                ptsMs = prefetchCap.get(cv::CAP_PROP_POS_MSEC);
+            }
+            
+            std::lock_guard<std::mutex> lock(prefetchMutex);
+            cv::Mat* frame = &decoded;
+            if (!decodeSize.empty()) {
+                cv::resize(decoded, scaled, decodeSize, 0, 0, cv::INTER_AREA);
+                frame = &scaled;
+            }
+            applyFilter(*frame);
+            if (yuv.packs(*frame)) {
+                yuv.pack(*frame, packed);
+                frame = &packed;
+            }
+            if (position == seekHandoffFrame && !seekHandoffReady) {
+                frame->copyTo(seekHandoffImage);
+                seekHandoffPtsMs = ptsMs;
+                seekHandoffReady = true;
+            }
+            frameCache.insert(position, *frame, ptsMs);
+        }
+    }
+    
+    int windowFlags() const {
+        return fitToWindow ? cv::WINDOW_NORMAL | cv::WINDOW_KEEPRATIO : cv::WINDOW_AUTOSIZE;
+    }
+    
+    /**
+     * Largest size with the video's aspect ratio inside 'bounds', never
+     * above the native resolution
+     */
+    cv::Size fitSize(cv::Size bounds) const {
+        double scale = std::min({1.0, static_cast<double>(bounds.width) / nativeSize.width,
+                                 static_cast<double>(bounds.height) / nativeSize.height});
+        return cv::Size(std::max(1, static_cast<int>(std::lround(nativeSize.width * scale))),
+                        std::max(1, static_cast<int>(std::lround(nativeSize.height * scale))));
+    }
+    
+    /**
+     * Apply 'change' to how frames come out of the decode stage (filters,
+     * decode size) while nothing else decodes, then drop every frame
+     * produced the old way and decode the current one again
+     */
+    void changeDecodeOutput(const std::function<void()>& change) {
+        stopDecodeAhead();
+        {
+            std::lock_guard<std::mutex> lock(prefetchMutex);
+            change();
+            seekHandoffReady = false; // Decoded the old way
+        }
+        reverseCache.clear();
+        frameCache.clear();
+        readFrameAt(currentFrameNumber);
+        startDecodeAhead();
+        if (pendingSeek >= 0) {
+            requestPrefetch(pendingSeek); // Its frames were just dropped
+        }
+    }
+    
+    /**
+     * Decode at 'size' from now on (empty: native). The backend is asked to
+     * scale first; file backends generally refuse, and retrieveScaled()
+     * then downscales straight after decode instead.
+     */
+    void applyDecodeSize(cv::Size size) {
+        changeDecodeOutput([&] {
+            decodeSize = size;
+            cv::Size request = size.empty() ? nativeSize : size;
+            cap.set(cv::CAP_PROP_FRAME_WIDTH, request.width);
+            cap.set(cv::CAP_PROP_FRAME_HEIGHT, request.height);
+        });
+        
+        // Smaller frames let the reverse cache hold more of them
+        size_t frameBytes = std::max<size_t>(1, currentFrame.total() * currentFrame.elemSize());
+        reverseCache.setCapacity(std::max<size_t>(2, reverseCacheBytes / frameBytes));
+        presentable(); // The overlay is placed on the presented frame
+        updateOverlayGeometry();
+    }
+    
+    std::string timelineWindowName() const {
+        return windowName + " - Timeline";
+    }
+    
+    /**
+     * Clicking a thumbnail requests a jump to its keyframe; the playback
+     * loop performs it after waitKey() returns
+     */
+    static void onTimelineMouse(int event, int x, int, int, void* userdata) {
+        if (event == cv::EVENT_LBUTTONDOWN) {
+            VideoPlayer* player = static_cast<VideoPlayer*>(userdata);
+            player->timelineClickFrame = player->filmstrip.frameAt(x);
+        }
+    }
+    
+    /**
+     * Open or close the filmstrip window just below the main window
+     */
+    void toggleFilmstrip() {
+        if (showFilmstrip) {
+            cv::destroyWindow(timelineWindowName());
+            showFilmstrip = false;
+            return;
+        }
+        if (!filmstrip.isReady()) {
+            std::cout << "\nFilmstrip not available yet (generated in the background)" << std::endl;
+            return;
+        }
+        cv::Rect mainRect = cv::getWindowImageRect(windowName);
+        cv::namedWindow(timelineWindowName(), cv::WINDOW_AUTOSIZE);
+        cv::moveWindow(timelineWindowName(), mainRect.x, mainRect.y + mainRect.height + 30);
+        cv::setMouseCallback(timelineWindowName(), &VideoPlayer::onTimelineMouse, this);
+        showFilmstrip = true;
+    }
+    
+    void displayFilmstrip() {
+        if (showFilmstrip) {
+            int width = std::min(std::max(currentFrame.cols, 640), 1920);
+            cv::imshow(timelineWindowName(), filmstrip.render(currentFrameNumber, totalFrames, width));
+        }
+    }
+    
+    /**
+     * First load phase, on the caller's thread: drop the previous file
+     */
+    void beginLoad(const std::string& filename) {
+        if (opener.joinable()) {
+            opener.join(); // An earlier loadVideoAsync() nobody waited for
+        }
+        opening.reset();
+        loadStart = std::chrono::steady_clock::now();
+        openMs = firstFrameMs = firstShownMs = -1.0;
+        stopIndexer();
+        stopPrefetch();
+        stopDecodeAhead();
+        pendingSeek = -1;
+        reverseCache.clear();
+        frameCache.clear();
+        videoPath = filename;
+        decodeSize = cv::Size();
+        if (useOpenGL) {
+            initOpenGLDisplay();
+        }
+        cap.release(); // May still be reading from the old mapping
+        inputMapping = std::make_shared<MappedFile>();
+        if (mappedInput && !inputMapping->open(filename)) {
+            std::cerr << "Warning: Cannot map " << filename << ", reading it normally" << std::endl;
+        }
+        inputMapping->setSequential(true);
+        readaheadForward = true;
+        readaheadFrom = 0;
+        inputMapping->willNeed(0, readaheadBytes);
+    }
+    
+    double msSinceLoadStart() const {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+    }
+    
+    /**
+     * What openFile() needs to open the file beginLoad() started loading
+     */
+    std::shared_ptr<OpenedFile> openRequest() const {
+        auto file = std::make_shared<OpenedFile>();
+        file->path = videoPath;
+        file->decoderParams = decoderParams();
+        file->loadStart = loadStart;
+        file->mapping = inputMapping;
+        return file;
+    }
+    
+    /**
+     * Second phase, on any one thread: open the capture, read the stream
+     * properties (from the index sidecar when it matches the file) and
+     * decode the first frame
+     */
+    static bool openFile(OpenedFile& file) {
+        openCapture(file);
+        
+        if (!file.cap.isOpened()) {
+            std::cerr << "Error: Cannot open video file: " << file.path << std::endl;
+            return false;
+        }
+        file.openMs = file.msSinceLoadStart();
+        
+        file.stamp = FileStamp::of(file.path);
+        file.indexFromSidecar = file.index.load(sidecarPath(file.path), file.stamp, file.streamInfo);
+        if (file.indexFromSidecar) {
+            file.totalFrames = file.streamInfo.frameCount;
+            file.fps = file.streamInfo.fps;
+        } else {
+            file.totalFrames = static_cast<int>(file.cap.get(cv::CAP_PROP_FRAME_COUNT));
+            file.fps = file.cap.get(cv::CAP_PROP_FPS);
+        }
+        
+        // Read first frame
+        if (!file.cap.read(file.firstFrame)) {
+            std::cerr << "Error: Cannot read first frame" << std::endl;
+            return false;
+        }
+        file.firstFrameMs = file.msSinceLoadStart();
+        return true;
+    }
+    
+    /**
+     * Take over the capture, first frame and stream properties openFile()
+     * produced, on the UI thread
+     */
+    void adoptOpenedFile(OpenedFile& file) {
+        cap = std::move(file.cap);
+        currentFrame = std::move(file.firstFrame);
+        keyframeIndex = std::move(file.index);
+        loadStamp = file.stamp;
+        loadStreamInfo = file.streamInfo;
+        indexFromSidecar = file.indexFromSidecar;
+        totalFrames = file.totalFrames;
+        fps = file.fps;
+        openMs = file.openMs;
+        firstFrameMs = file.firstFrameMs;
+        selectPixelLayout();
+        currentFrameNumber = 0;
+        currentPtsMs = 0.0;
+        decodePosition = 1;
+        currentFrameOnGpu = false;
+        nativeSize = currentFrame.size();
+        if (ToneMapper::needsMapping(currentFrame)) {
+            // One depth for the whole stream, shared with the filmstrip and scene analysis
+            toneMapper.setSignificantBits(ToneMapper::streamBits(
+                static_cast<int>(cap.get(cv::CAP_PROP_CODEC_PIXEL_FORMAT)), currentFrame));
+        }
+        gpuResidentFrames = useOpenGL && cap.get(cv::CAP_PROP_HW_ACCELERATION_USE_OPENCL) > 0;
+    }
+    
+    /**
+     * Index sidecar contents for the scanned index
+     */
+    void updateStreamInfo() {
+        loadStreamInfo.frameCount = totalFrames;
+        loadStreamInfo.fps = fps;
+        loadStreamInfo.width = nativeSize.width;
+        loadStreamInfo.height = nativeSize.height;
+    }
+    
+    /**
+     * Last phase, on the UI thread: index keyframes (or start scanning for
+     * them in the background), set up caches and start decoding ahead
+     */
+    void finishLoad(bool indexInBackground) {
+        // A mapped file gets keyframe byte offsets, which older sidecars lack
+        bool wantOffsets = KeyframeIndex::recordsByteOffsets && inputMapping->data() && 
+                           indexFromSidecar && !keyframeIndex.hasByteOffsets();
+        indexLoadsDeferred = false;
+        if ((!indexFromSidecar || wantOffsets) && indexInBackground) {
+            startIndexer();
+            indexLoadsDeferred = !indexFromSidecar && !headless;
+        } else if ((!indexFromSidecar || wantOffsets) && keyframeIndex.build(videoPath, inputMapping.get())) {
+            indexFromSidecar = false;
+            // The scan counts real frames; headers of VFR or damaged files lie
+            totalFrames = keyframeIndex.frameCount();
+            updateStreamInfo();
+            if (!headless) {
+                keyframeIndex.save(sidecarPath(videoPath), loadStamp, loadStreamInfo);
+            }
+        } else if (wantOffsets) {
+            keyframeIndex.load(sidecarPath(videoPath), loadStamp, loadStreamInfo); // Keep the old index
+        }
+        if (!indexLoadsDeferred && !headless) {
+            filmstrip.load(videoPath, keyframeIndex.getKeyframes(), nativeSize, toneMapper);
+            sceneIndex.load(videoPath, keyframeIndex.getKeyframes(), totalFrames, analyseScenes, 
+                            toneMapper.getSignificantBits());
+        }
+        
+        if (!gpuResidentFrames) {
+            frameQueue.allocate(currentFrame.rows, currentFrame.cols, currentFrame.type());
+        }
+        // Packed frames take half the bytes of BGR, so the cache holds twice as many
+        size_t frameBytes = currentFrame.total() * currentFrame.elemSize();
+        if (yuv.packs(currentFrame)) {
+            frameBytes /= 2;
+        }
+        reverseCache.setCapacity(std::max<size_t>(2, reverseCacheBytes / frameBytes));
+        int decodedDepth = currentFrame.depth();
+        presentable();
+        updateOverlayGeometry();
+        startDecodeAhead();
+        
+        if (!verbose) {
+            return;
+        }
+        
+        std::cout << "Video loaded successfully:" << std::endl;
+        std::cout << "  Total frames: " << totalFrames << (indexer.joinable() && !indexFromSidecar ? " (from the header)" : "") << std::endl;
+        std::cout << "  FPS: " << fps << std::endl;
+        std::cout << "  Resolution: " << nativeSize.width << "x" << nativeSize.height << std::endl;
+        std::cout << "  Decoder: " << describeDecoder() << std::endl;
+        char startup[96];
+        std::snprintf(startup, sizeof(startup), "opened in %.1f ms, first frame decoded in %.1f ms", 
+                      openMs, firstFrameMs);
+        std::cout << "  Startup: " << startup << std::endl;
+        if (yuv.getLayout() != PixelLayout::BGR) {
+            std::cout << "  Cached frames: " << yuv.describe() << ", converted when presented" << std::endl;
+        }
+        if (decodedDepth != CV_8U) {
+            std::cout << "  Frames: " << toneMapper.getSignificantBits() << "-bit, tone mapped (" 
+                      << toneMapper.describe() << ") when presented" << std::endl;
+        }
+        if (inputMapping->data()) {
+            std::cout << "  Input: memory-mapped, " << (inputMapping->size() >> 20) << " MB"
+                      << (keyframeIndex.hasByteOffsets() ? ", GOP prefetch by offset" : "") << std::endl;
+        }
+        if (useOpenGL) {
+            std::cout << "  Display: OpenGL (" 
+                      << (gpuResidentFrames ? "GPU-resident frames" : "host upload") << ")" << std::endl;
+        }
+        if (indexer.joinable() && !indexFromSidecar) {
+            std::cout << "  Keyframes: indexing in the background" << std::endl;
+        } else if (keyframeIndex.empty()) {
+            std::cout << "  Keyframes: not indexed (backend seeking)" << std::endl;
+        } else {
+            std::cout << "  Keyframes: " << keyframeIndex.keyframeCount() 
+                      << (indexFromSidecar ? " (from index sidecar)" : "") << std::endl;
+        }
+        if (sceneIndex.isReady()) {
+            std::cout << "  Scenes: " << sceneIndex.sceneCount() << " (from scene index)" << std::endl;
+        } else if (analyseScenes && !indexLoadsDeferred) {
+            std::cout << "  Scenes: analysing in the background" << std::endl;
+        }
+    }
+    
+    /**
+     * Scan keyframes into scannedIndex on 'indexer'
+     */
+    void startIndexer() {
+        indexFinished = false;
+        indexCancel = false;
+        indexer = std::thread([this] {
+            scannedIndexOk = scannedIndex.build(videoPath, inputMapping.get(), &indexCancel);
+            indexFinished = true;
+        });
+    }
+    
+    void stopIndexer() {
+        indexCancel = true;
+        if (indexer.joinable()) {
+            indexer.join();
+        }
+    }
+    
+    /**
+     * Take over the background scan once it has finished: the decode and
+     * prefetch threads stop while the index and frame count change, and
+     * decoding resumes after the frame on screen. True if it was adopted.
+     */
+    bool adoptScannedIndex() {
+        if (!indexer.joinable() || !indexFinished) {
+            return false;
+        }
+        indexer.join();
+        if (scannedIndexOk) {
+            stopPrefetch();
+            stopDecodeAhead();
+            keyframeIndex = std::move(scannedIndex);
+            indexFromSidecar = false;
+            // The scan counts real frames; headers of VFR or damaged files lie
+            totalFrames = keyframeIndex.frameCount();
+            currentFrameNumber = std::min(currentFrameNumber, totalFrames - 1);
+            updateStreamInfo();
+            if (!headless) {
+                keyframeIndex.save(sidecarPath(videoPath), loadStamp, loadStreamInfo);
+            }
+            startDecodeAheadAt(currentFrameNumber + 1);
+            if (pendingSeek >= 0) {
+                requestPrefetch(std::min(pendingSeek, totalFrames - 1));
+            }
+        }
+        if (indexLoadsDeferred) {
+            filmstrip.load(videoPath, keyframeIndex.getKeyframes(), nativeSize, toneMapper);
+            sceneIndex.load(videoPath, keyframeIndex.getKeyframes(), totalFrames, analyseScenes, 
+                            toneMapper.getSignificantBits());
+            indexLoadsDeferred = false;
+        }
+        if (verbose) {
+            if (keyframeIndex.empty()) {
+                std::cout << "\nKeyframes: not indexed (backend seeking)" << std::endl;
+            } else {
+                std::cout << "\nKeyframes: " << keyframeIndex.keyframeCount() << " indexed, " 
+                          << totalFrames << " frames" << std::endl;
+            }
+        }
+        return true;
+    }
+    
+    /**
+     * Map the window with an "Opening..." placeholder until the first frame
+     */
+    void showOpeningPlaceholder() {
+        if (!useOpenGL) { // The OpenGL window is already up
+            cv::namedWindow(windowName, windowFlags());
+        }
+        cv::Mat placeholder(fitInitialHeight / 2, fitInitialWidth / 2, CV_8UC3, cv::Scalar(0, 0, 0));
+        cv::putText(placeholder, "Opening " + std::filesystem::path(videoPath).filename().string() + "...", 
+                    cv::Point(10, 30), cv::FONT_HERSHEY_SIMPLEX, 0.6, cv::Scalar(0, 255, 0), 1);
+        cv::imshow(windowName, placeholder);
+    }
+    
+    /**
+     * Keep the placeholder window responsive while 'opener' runs, then
+     * finish loading here. False if opening failed or the window was quit
+     * first. Opening cannot be interrupted, so a quit detaches 'opener',
+     * which then finishes on its own OpenedFile and drops it.
+     */
+    bool awaitOpen() {
+        showOpeningPlaceholder();
+        bool quit = false;
+        while (!opening->finished && !quit) {
+            int key = cv::waitKey(openPollMs) & 0xFF;
+            quit = key == 'q' || key == 'Q' || key == 27;
+        }
+        if (quit) {
+            opener.detach();
+            opening.reset();
+            openAbandoned = true;
+            cv::destroyAllWindows();
+            return false;
+        }
+        opener.join();
+        std::shared_ptr<OpenedFile> file = std::move(opening);
+        if (!file->succeeded) {
+            currentFrame.release();
+            return false;
+        }
+        adoptOpenedFile(*file);
+        finishLoad(true);
+        return true;
+    }
+    
+    /**
+     * Record time-to-first-frame when the first frame of a load is shown
+     */
+    void noteFirstShown() {
+        if (firstShownMs >= 0.0) {
+            return;
+        }
+        firstShownMs = msSinceLoadStart();
+        if (verbose) {
+            char startup[64];
+            std::snprintf(startup, sizeof(startup), "first frame on screen after %.1f ms", firstShownMs);
+            std::cout << "Startup: " << startup << std::endl;
+        }
+    }
+    
+    /**
+     * Keep the frame on screen in the LRU cache for later scrubbing
+     */
+    void rememberCurrentFrame() {
+        if (yuv.packs(currentFrame)) {
+            yuv.pack(currentFrame, rememberScratch);
+            frameCache.insert(currentFrameNumber, rememberScratch, currentPtsMs);
+        } else {
+            frameCache.insert(currentFrameNumber, currentFrame, currentPtsMs);
+        }
+    }
+    
+    /**
+     * Advance one frame. Frames already queued by the decode thread are
+     * taken from the queue; otherwise the caches are checked before 'cap'.
+     * Continuous playback passes cacheResult=false so every presented frame
+     * is not copied into the LRU cache.
+     */
+    bool stepForward(bool cacheResult) {
+        if (currentFrameNumber >= totalFrames - 1) {
+            return false; // At end of video
+        }
+        
+        // While skipping, the queue holds every n-th frame; manual steps
+        // still move by one
+        int target = currentFrameNumber + 1;
+        if (queuedPosition == target && (decodeStride == 1 || !cacheResult)) {
+            int frameNumber;
+            double ptsMs;
+            if (!frameQueue.pop(currentFrame, currentGpuFrame, frameNumber, ptsMs)) {
+                return false;
+            }
+            queuedPosition = frameNumber + 1;
+            currentFrameNumber = frameNumber;
+            currentPtsMs = ptsMs;
+            currentFrameOnGpu = gpuResidentFrames;
+            scheduleDecodeTask();
+        } else if (showCachedFrame(target)) {
+            return true;
+        } else {
+            // Stepping back leaves the queue ahead of the frame on screen
+            stopDecodeAhead();
+            bool ok = readFrameAt(target);
+            startDecodeAhead();
+            if (!ok) {
+                return false;
+            }
+        }
+        
+        adviseReadahead(true);
+        if (cacheResult) {
+            if (currentFrameOnGpu) {
+                // Manual steps may read back; continuous playback never does
+                currentGpuFrame.copyTo(currentFrame);
+                currentFrameOnGpu = false;
+            }
+            rememberCurrentFrame();
+        }
+        return true;
+    }
+    
+public:
+    VideoPlayer() : inputMapping(std::make_shared<MappedFile>()), windowName("Simple Video Player"), verbose(true), headless(false),
+                         decodeBackend(DecodeBackend::Software), hwDevice(-1),
+                         mappedInput(false), analyseScenes(false), playAudio(true), readaheadForward(true), readaheadFrom(0),
+                         totalFrames(0), currentFrameNumber(0), fps(30.0),
+                         currentPtsMs(0.0), playbackRate(1.0), decodeStride(1), keyframeScan(false),
+                         useOpenGL(false), gpuResidentFrames(false),
+                         currentFrameOnGpu(false), showHud(false), nativeFrames(false), fitToWindow(false),
+                         showFilmstrip(false), timelineClickFrame(-1),
+                         frameCache(defaultFrameCacheBytes), enteringFrame(false),
+                         prefetchRequest(-1), seekHandoffFrame(-1), seekHandoffReady(false),
+                         seekHandoffPtsMs(0.0), prefetchStop(false), exportIn(0), exportOut(0),
+                         exportRunning(false), exportCancel(false), controlPort(0),
+                         frameQueue(decodeAheadFrames), decodePool(nullptr),
+                         decodeAheadActive(false), decodeTaskScheduled(false),
+                         decodePosition(0), queuedPosition(0), decodeResumeAt(-1), decodeCancel(false),
+                         pendingSeek(-1), openAbandoned(false), indexFinished(false),
+                         indexCancel(false), scannedIndexOk(false), indexLoadsDeferred(false),
+                         indexFromSidecar(false), openMs(-1.0), firstFrameMs(-1.0), firstShownMs(-1.0) {}
+    
+    ~VideoPlayer() {
+        exportCancel = true;
+        if (exportThread.joinable()) {
+            exportThread.join();
+        }
+        if (opener.joinable()) {
+            opener.join(); // Started but never awaited
+        }
+        stopIndexer();
+        stopPrefetch();
+        stopDecodeAhead();
+    }
+    
+    /**
+     * Load video file and initialize player: open it, decode the first
+     * frame and index keyframes before returning
+     */
+    bool loadVideo(const std::string& filename) {
+        beginLoad(filename);
+        std::shared_ptr<OpenedFile> file = openRequest();
+        if (!openFile(*file)) {
+            return false;
+        }
+        adoptOpenedFile(*file);
+        finishLoad(false);
+        return true;
+    }
+    
+    /**
+     * Start loading on a background thread and return at once;
+     * startPlayback() maps the window meanwhile and shows the first frame
+     * the moment it is decoded. Frame count and keyframe index are filled
+     * in while playing. isLoaded() tells afterwards whether it worked.
+     * With the OpenGL display the file opens here instead, behind the
+     * placeholder: its OpenCL context is bound to this thread, which the
+     * decoder must share.
+     */
+    void loadVideoAsync(const std::string& filename) {
+        beginLoad(filename);
+        openAbandoned = false;
+        std::shared_ptr<OpenedFile> file = openRequest();
+        if (useOpenGL) {
+            showOpeningPlaceholder();
+            cv::waitKey(1); // Draw it before the open blocks this thread
+            if (openFile(*file)) {
+                adoptOpenedFile(*file);
+                finishLoad(true);
+            } else {
+                currentFrame.release();
+            }
+            return;
+        }
+        opening = file;
+        opener = std::thread([file] {
+            file->succeeded = openFile(*file);
+            file->finished = true;
+        });
+    }
+    
+    /**
+     * True if startPlayback() was quit while the file was still opening;
+     * nothing was loaded then, but nothing failed either
+     */
+    bool isOpenAbandoned() const {
+        return openAbandoned;
+    }
+    
+    /**
+     * True once a file is open and its first frame decoded
+     */
+    bool isLoaded() const {
+        return !currentFrame.empty() || currentFrameOnGpu;
+    }
+    
+    /**
+     * Move to next frame
+     */
+    bool nextFrame() {
+        return stepForward(true);
+    }
+    
+    /**
+     * Move to previous frame
+     */
+    bool previousFrame() {
+        if (currentFrameNumber <= 0) {
+            return false; // At beginning of video
+        }
+        
+        // Backward steps are served from a GOP decoded forward once; only
+        // leaving the cached run costs another decode pass
+        int target = currentFrameNumber - 1;
+        bool ok = showCachedFrame(target);
+        if (!ok) {
+            stopDecodeAhead();
+            ok = fillReverseCache(target);
+            startDecodeAhead();
+            ok = ok && showReverseCachedFrame(target);
+        }
+        // Stepped frames go into the LRU like forward steps, so they outlive
+        // the next refill of the reverse run
+        if (ok && !frameCache.contains(target)) {
+            rememberCurrentFrame();
+        }
+        adviseReadahead(false);
+        return ok;
+    }
+    
+    /**
+     * Jump to specific frame number
+     */
+    bool seekToFrame(int frameNumber) {
+        if (frameNumber < 0 || frameNumber >= totalFrames) {
+            return false;
+        }
+        pendingSeek = -1; // Superseded
+        
+        if (showCachedFrame(frameNumber)) {
+            return true;
+        }
+        
+        stopDecodeAhead();
+        bool ok = readFrameAt(frameNumber);
+        startDecodeAhead();
+        if (ok) {
+            rememberCurrentFrame();
+        }
+        return ok;
+    }
+    
+    /**
+     * Seek for scrubbing, without waiting on decoding. A cached target is
+     * shown at once; otherwise a stand-in is shown while the prefetch
+     * thread decodes the exact frame, and pollSeek() presents it when it
+     * lands; it is handed over directly, so it needs no room in the LRU
+     * cache. A newer target makes the prefetch thread drop the old one
+     * between frames. 'backward' caches the frames leading up to the
+     * target rather than those after it.
+     */
+    bool beginSeek(int frameNumber, bool backward = false) {
+        if (frameNumber < 0 || frameNumber >= totalFrames) {
+            return false;
+        }
+        if (showCachedFrame(frameNumber)) {
+            pendingSeek = -1;
+            return true;
+        }
+        {
+            std::lock_guard<std::mutex> lock(prefetchMutex);
+            seekHandoffFrame = frameNumber;
+            seekHandoffReady = false;
+        }
+        pendingSeek = frameNumber;
+        pendingSeekSince = std::chrono::steady_clock::now();
+        requestPrefetch(backward ? std::max(0, frameNumber - prefetchFrames + 1) : frameNumber);
+        showStandIn(frameNumber);
+        return true;
+    }
+    
+    /**
+     * Show the cached frame closest to 'frameNumber', or the thumbnail of a
+     * keyframe before it if that is closer; otherwise keep the frame on
+     * screen. Stand-ins are never cached.
+     */
+    void showStandIn(int frameNumber) {
+        int cached = frameCache.nearest(frameNumber);
+        cv::Mat thumbnail;
+        int thumbnailFrame = filmstrip.thumbnailBefore(frameNumber, thumbnail);
+        if (cached >= 0 && (thumbnailFrame < 0 || std::abs(cached - frameNumber) <= frameNumber - thumbnailFrame)) {
+            showCachedFrame(cached);
+        } else if (thumbnailFrame >= 0) {
+            cv::resize(thumbnail, currentFrame, decodeSize.empty() ? nativeSize : decodeSize, 0, 0, cv::INTER_LINEAR);
+            currentFrameNumber = thumbnailFrame;
+            currentPtsMs = framePts(thumbnailFrame);
+            currentFrameOnGpu = false;
+        }
+    }
+    
+    /**
+     * Finish a pending beginSeek() once its frame is cached, and resume
+     * decoding ahead after the frames the prefetch thread cached with it.
+     * After seekTimeoutMs (prefetch failed) it seeks synchronously. True
+     * when the seek completed.
+     */
+    bool pollSeek() {
+        if (pendingSeek < 0) {
+            return false;
+        }
+        int target = pendingSeek;
+        if (!takeSeekHandoff(target) && !showCachedFrame(target)) {
+            if (std::chrono::steady_clock::now() - pendingSeekSince < std::chrono::milliseconds(seekTimeoutMs)) {
+                return false;
+            }
+            pendingSeek = -1;
+            seekToFrame(target);
+            return true;
+        }
+        pendingSeek = -1;
+        int resume = target + 1;
+        while (resume < totalFrames && resume < target + prefetchFrames && frameCache.contains(resume)) {
+            resume++;
+        }
+        startDecodeAheadAt(resume);
+        return true;
+    }
+    
+    /**
+     * Present 'frameNumber' from the prefetch thread's handoff slot
+     */
+    bool takeSeekHandoff(int frameNumber) {
+        std::lock_guard<std::mutex> lock(prefetchMutex);
+        if (!seekHandoffReady || seekHandoffFrame != frameNumber) {
+            return false;
+        }
+        cv::swap(currentFrame, seekHandoffImage);
+        currentFrameNumber = frameNumber;
+        currentPtsMs = seekHandoffPtsMs;
+        currentFrameOnGpu = false;
+        seekHandoffFrame = -1;
+        seekHandoffReady = false;
+        return true;
+    }
+    
+    /**
+     * True while a beginSeek() target is still being decoded
+     */
+    bool isSeekPending() const {
+        return pendingSeek >= 0;
+    }
+    
+    /**
+     * Display current frame in window
+     */
+    void displayFrame() {
+        if (!currentFrame.empty() || currentFrameOnGpu) {
+            if (!currentFrameOnGpu) {
+                presentable();
+            }
+            // Add frame info overlay directly on the frame; only the small
+            // region under the text is saved and restored, so presenting a
+            // frame neither clones it nor allocates
+            formatOverlayText();
+            
+            if (useOpenGL) {
+                displayFrameOpenGL();
+                noteFirstShown();
+                return;
+            }
+            
+            using Clock = std::chrono::steady_clock;
+            auto micros = [](Clock::duration d) {
+                return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+            };
+            
+            auto overlayStart = Clock::now();
+            drawOverlay();
+            auto showStart = Clock::now();
+            cv::imshow(windowName, currentFrame);
+            auto showEnd = Clock::now();
+            restoreOverlay();
+            
+            stats.overlay.record(micros(showStart - overlayStart) + micros(Clock::now() - showEnd));
+            stats.show.record(micros(showEnd - showStart));
+            noteFirstShown();
+        }
+    }
+    
+    /**
+     * Print current frame information
+     */
+    void printFrameInfo() {
+        double progress = (double)(currentFrameNumber + 1) / totalFrames * 100.0;
+        std::cout << "\rFrame: " << (currentFrameNumber + 1) << "/" << totalFrames 
+                  << " (" << std::fixed << std::setprecision(1) << progress << "%)";
+        if (scheduler.getDroppedFrames() > 0) {
+            std::cout << " dropped: " << scheduler.getDroppedFrames();
+        }
+        if (pendingSeek >= 0) {
+            std::cout << " seeking to " << (pendingSeek + 1);
+        }
+        std::cout << std::flush;
+    }
+    
+    /**
+     * Create the display window (the OpenGL window already exists)
+     */
+    void createWindow() {
+        if (!useOpenGL) {
+            cv::namedWindow(windowName, windowFlags());
+        }
+        if (fitToWindow) {
+            cv::Size initial = fitSize(cv::Size(fitInitialWidth, fitInitialHeight));
+            cv::resizeWindow(windowName, initial.width, initial.height);
+            refitToWindow();
+        }
+    }
+    
+    /**
+     * Switch between native-size and fit-to-window display. The OpenGL
+     * window keeps the mode it was created with (see --fit).
+     */
+    void toggleFitToWindow() {
+        if (useOpenGL) {
+            std::cout << "\nFit to window is fixed for OpenGL windows; use --fit" << std::endl;
+            return;
+        }
+        fitToWindow = !fitToWindow;
+        cv::destroyWindow(windowName);
+        createWindow();
+        if (!fitToWindow) {
+            applyDecodeSize(cv::Size());
+        }
+        std::cout << "\nFit to window: " << (fitToWindow ? "on" : "off") << std::endl;
+    }
+    
+    /**
+     * Re-target decoding when the window was resized noticeably (more than
+     * a few pixels, so a drag does not flush the caches on every event).
+     * True if the frame on screen was re-decoded.
+     */
+    bool refitToWindow() {
+        if (!fitToWindow) {
+            return false;
+        }
+        cv::Rect window = cv::getWindowImageRect(windowName);
+        if (window.width <= 0 || window.height <= 0) {
+            return false;
+        }
+        cv::Size target = fitSize(window.size());
+        cv::Size current = decodeSize.empty() ? nativeSize : decodeSize;
+        if (std::abs(target.width - current.width) > 8 || std::abs(target.height - current.height) > 8) {
+            applyDecodeSize(target == nativeSize ? cv::Size() : target);
+            return true;
+        }
+        return false;
+    }
+    
+    /**
+     * Show or hide the stats HUD
+     */
+    void toggleHud() {
+        showHud = !showHud;
+        updateOverlayGeometry();
+    }
+    
+    /**
+     * Start typing a frame number into the window
+     */
+    void beginFrameEntry() {
+        enteringFrame = true;
+        frameEntry.clear();
+    }
+    
+    bool isEnteringFrame() const {
+        return enteringFrame;
+    }
+    
+    /**
+     * Digits typed so far into the frame entry
+     */
+    const std::string& getFrameEntry() const {
+        return frameEntry;
+    }
+    
+    enum class EntryKey { Ignored, Edited, Cancelled, Finished };
+    
+    /**
+     * Apply a key to the digits of a frame entry of at most 'maxDigits':
+     * digits and Backspace edit it, ESC cancels, Enter finishes
+     */
+    static EntryKey editFrameEntry(std::string& entry, int key, size_t maxDigits) {
+        if (key >= '0' && key <= '9' && entry.size() < maxDigits) {
+            entry += static_cast<char>(key);
+            return EntryKey::Edited;
+        }
+        if ((key == 8 || key == 127) && !entry.empty()) {
+            entry.pop_back();
+            return EntryKey::Edited;
+        }
+        if (key == 27) {
+            return EntryKey::Cancelled;
+        }
+        if (key == 13 || key == 10) {
+            return EntryKey::Finished;
+        }
+        return EntryKey::Ignored;
+    }
+    
+    /**
+     * 0-based frame an entry names, or -1 if empty
+     */
+    static int frameEntryTarget(const std::string& entry) {
+        return entry.empty() ? -1 : std::atoi(entry.c_str()) - 1;
+    }
+    
+    /**
+     * Feed a key to the frame entry: digits and Backspace edit it (each
+     * edit prefetches around the new number), ESC cancels, Enter finishes.
+     * Returns true on Enter with the 0-based target in 'frameNumber'.
+     */
+    bool frameEntryKey(int key, int& frameNumber) {
+        switch (editFrameEntry(frameEntry, key, std::to_string(totalFrames).size())) {
+            case EntryKey::Edited:
+                showFrameEntry(frameEntry);
+                break;
+            case EntryKey::Cancelled:
+                enteringFrame = false;
+                break;
+            case EntryKey::Finished:
+                enteringFrame = false;
+                frameNumber = frameEntryTarget(frameEntry);
+                return true;
+            case EntryKey::Ignored:
+                break;
+        }
+        return false;
+    }
+    
+    /**
+     * Show 'digits' as the frame entry and prefetch around the frame they
+     * name; MultiStreamPlayer types one entry for all its streams this way
+     */
+    void showFrameEntry(const std::string& digits) {
+        enteringFrame = true;
+        frameEntry = digits;
+        int target = frameEntryTarget(frameEntry);
+        if (target >= 0 && target < totalFrames) {
+            requestPrefetch(target);
+        }
+    }
+    
+    void endFrameEntry() {
+        enteringFrame = false;
+    }
+    
+    /**
+     * Change the playback speed. Above 1x only every n-th frame is
+     * presented; from 8x, with a keyframe index, playback scans keyframes.
+     * The decode thread picks the new stride up with its next frame.
+     */
+    void setPlaybackRate(double rate) {
+        playbackRate = rate;
+        decodeStride = rate > 1.0 ? static_cast<int>(std::lround(rate)) : 1;
+        keyframeScan = rate >= 8.0 && !keyframeIndex.empty();
+        scheduler.setRate(rate);
+        std::cout << "\nSpeed: " << rate << "x" 
+                  << (keyframeScan ? " (keyframes only)" : "") << std::endl;
+    }
+    
+    double getPlaybackRate() const {
+        return playbackRate;
+    }
+    
+    /**
+     * Filter keys: 1/2 brightness, 3/4 contrast, 5/6 gamma, 7 grayscale,
+     * 0 reset. Decoded frames were filtered with the old settings, so the
+     * ring and caches are dropped and the current frame is decoded again.
+     * Returns false if 'key' is not a filter key.
+     */
+    bool handleFilterKey(int key) {
+        std::function<void()> change;
+        switch (key) {
+            case '1': change = [this] { filter.adjustBrightness(-10); }; break;
+            case '2': change = [this] { filter.adjustBrightness(10); }; break;
+            case '3': change = [this] { filter.adjustContrast(-0.1); }; break;
+            case '4': change = [this] { filter.adjustContrast(0.1); }; break;
+            case '5': change = [this] { filter.adjustGamma(-0.1); }; break;
+            case '6': change = [this] { filter.adjustGamma(0.1); }; break;
+            case '7': change = [this] { filter.toggleGrayscale(); }; break;
+            case '0': change = [this] { filter.reset(); }; break;
+            default: return false;
+        }
+        
+        changeDecodeOutput(change);
+        std::cout << "\nFilter: " << filter.describe() << std::endl;
+        return true;
+    }
+    
+    /**
+     * Restart pacing from the frame on screen. At 1x the audio keeps
+     * playing unless it drifted from the video (a seek); at other speeds
+     * or paused it is silent and the steady clock paces alone.
+     */
+    void resyncClock(bool playing) {
+        scheduler.anchor(currentPtsMs);
+        if (!audio.isOpen()) {
+            return;
+        }
+        if (!playing || playbackRate != 1.0 || pendingSeek >= 0) {
+            audio.stop();
+            return;
+        }
+        // Still starting (clock not yet audible) counts as in sync
+        double audioMs = audio.clockMs();
+        if (!audio.isPlaying() || (audioMs >= 0.0 && std::abs(audioMs - currentPtsMs) > audioResyncMs)) {
+            audio.start(currentPtsMs);
+        }
+    }
+    
+    /**
+     * Advance until the frame on screen covers 'ptsMs' on an external
+     * master clock, dropping frames that are already past. Returns false
+     * at the end of the video.
+     */
+    bool advanceToTime(double ptsMs) {
+        bool advanced = false;
+        while (currentPtsMs + presentedIntervalMs() <= ptsMs) {
+            if (!stepForward(false)) {
+                return false;
+            }
+            if (advanced) {
+                scheduler.countDroppedFrame();
+            }
+            advanced = true;
+        }
+        return true;
+    }
+    
+    /**
+     * Run a command on the playback loop's thread; keys and the control
+     * socket both end up here
+     */
+    void applyCommand(const PlayerCommand& command, bool& playing, bool& quit) {
+        bool wasPlaying = playing;
+        switch (command.type) {
+            case PlayerCommand::Type::Play:
+                playing = true;
+                break;
+            case PlayerCommand::Type::Pause:
+                playing = false;
+                break;
+            case PlayerCommand::Type::TogglePause:
+                playing = !playing;
+                break;
+            case PlayerCommand::Type::Seek:
+                if (!beginSeek(static_cast<int>(command.value))) {
+                    std::cout << "\nInvalid frame number!" << std::endl;
+                }
+                break;
+            case PlayerCommand::Type::Step:
+                if (pendingSeek >= 0 || std::abs(command.value) > stepSeekFrames) {
+                    // Scrubbing steps from the target, not from the stand-in
+                    int from = pendingSeek >= 0 ? pendingSeek : currentFrameNumber;
+                    int target = static_cast<int>(std::clamp(from + command.value, 0.0, totalFrames - 1.0));
+                    beginSeek(target, command.value < 0);
+                    break;
+                }
+                for (int i = 0; i < std::abs(static_cast<int>(command.value)); i++) {
+                    if (command.value > 0 && !nextFrame()) {
+                        std::cout << "\nEnd of video reached" << std::endl;
+                        playing = false;
+                        break;
+                    }
+                    if (command.value < 0 && !previousFrame()) {
+                        std::cout << "\nBeginning of video reached" << std::endl;
+                        break;
+                    }
+                }
+                break;
+            case PlayerCommand::Type::Speed:
+                setPlaybackRate(std::clamp(command.value, 0.25, 16.0));
+                break;
+            case PlayerCommand::Type::Quit:
+                quit = true;
+                break;
+        }
+        if (playing != wasPlaying) {
+            std::cout << "\n" << (playing ? "▶ Playing" : "⏸ Paused");
+            if (!playing) {
+                std::cout << " (dropped " << scheduler.getDroppedFrames() << " frames)";
+            }
+            std::cout << std::endl;
+        }
+    }
+    
+    /**
+     * Main playback loop with controls
+     */
+    void startPlayback() {
+        if (opener.joinable() && !awaitOpen()) {
+            return;
+        }
+        if (currentFrame.empty()) {
+            std::cerr << "No video loaded!" << std::endl;
+            return;
+        }
+        
+        createWindow();
+        displayFrame(); // Before opening the audio track, a second open of the file
+        
+        if (playAudio && audio.open(videoPath)) {
+            std::cout << "Audio: " << audio.getSampleRate() << " Hz, " << audio.getChannels() 
+                      << " channels (video follows the audio clock at 1x)" << std::endl;
+            scheduler.setMasterClock([this] { return audio.clockMs(); });
+        }
+        
+        // Show controls
+        std::cout << "\n=== Simple Video Player Controls ===" << std::endl;
+        std::cout << "SPACE    : Play/Pause" << std::endl;
+        std::cout << "→ or D   : Next frame" << std::endl;
+        std::cout << "← or A   : Previous frame" << std::endl;
+        std::cout << "HOME     : Go to first frame" << std::endl;
+        std::cout << "END      : Go to last frame" << std::endl;
+        std::cout << "G        : Go to frame (type the number, Enter / ESC)" << std::endl;
+        std::cout << "S        : Toggle stats HUD" << std::endl;
+        std::cout << "T        : Toggle filmstrip (click a thumbnail to jump)" << std::endl;
+        std::cout << "F        : Toggle fit to window (decodes at window size)" << std::endl;
+        std::cout << "[ / ]    : Slower / faster (0.25x-16x)" << std::endl;
+        std::cout << "N / P    : Next / previous scene" << std::endl;
+        std::cout << "I / O    : Mark export in / out frame" << std::endl;
+        std::cout << "X        : Export marked range as PNG" << std::endl;
+        std::cout << "1-6      : Brightness / contrast / gamma down, up" << std::endl;
+        std::cout << "7 / 0    : Toggle grayscale / reset filters" << std::endl;
+        std::cout << "ESC or Q : Quit" << std::endl;
+        std::cout << "===================================\n" << std::endl;
+        
+        if (controlPort > 0) {
+            controlServer = std::make_unique<ControlServer>(commands);
+            if (controlServer->start(controlPort)) {
+                std::cout << "Control: 127.0.0.1:" << controlPort 
+                          << " (play, pause, toggle, seek N, step [N], speed X, quit)" << std::endl;
+            } else {
+                std::cerr << "Warning: Cannot listen on control port " << controlPort << std::endl;
+                controlServer.reset();
+            }
+        }
+        
+        bool playing = false;
+        bool quit = false;
+        bool idle = false; // Paused and nothing changed: skip redrawing
+        
+        while (!quit) {
+            if (!idle) {
+                displayFrame();
+                displayFilmstrip();
+                printFrameInfo();
+            }
+            idle = false;
+            
+            // When playing, fetch the next frame now and sleep until its PTS is
+            // due; when paused, wait indefinitely for a key
+            int delay = 0;
+            if (pendingSeek >= 0) {
+                delay = seekPollMs; // Hold the stand-in until the target lands
+            } else if (playing) {
+                if (advanceOnSchedule()) {
+                    delay = scheduler.delayUntil(currentPtsMs);
+                } else {
+                    std::cout << "\nEnd of video reached (dropped " 
+                              << scheduler.getDroppedFrames() << " frames)" << std::endl;
+                    playing = false;
+                    audio.stop();
+                }
+            }
+            
+            // While paused, wake up regularly to pick up remote commands
+            if (delay == 0 && controlServer) {
+                delay = commandPollMs;
+            }
+            if (delay == 0 && indexer.joinable()) {
+                delay = indexPollMs; // Adopt the keyframe scan when it lands
+            }
+            int key = cv::waitKey(delay) & 0xFF;
+            bool changed = refitToWindow();
+            
+            // Remote commands are drained without locking, then pacing
+            // restarts as for a handled key
+            bool commandsRan = commands.drain(commandBatch);
+            for (const PlayerCommand& command : commandBatch) {
+                applyCommand(command, playing, quit);
+            }
+            if (commandsRan) {
+                resyncClock(playing);
+            }
+            if (pollSeek()) {
+                resyncClock(playing);
+                changed = true;
+            }
+            if (adoptScannedIndex()) {
+                resyncClock(playing);
+                changed = true;
+            }
+            
+            if (timelineClickFrame >= 0) {
+                beginSeek(timelineClickFrame);
+                timelineClickFrame = -1;
+                resyncClock(playing);
+                changed = true;
+            }
+            
+            // Typing a frame number keeps playback and decoding going
+            if (enteringFrame && key != 0xFF) {
+                int targetFrame;
+                if (frameEntryKey(key, targetFrame)) {
+                    if (beginSeek(targetFrame)) {
+                        std::cout << "\nJumped to frame " << (targetFrame + 1) << std::endl;
+                    } else {
+                        std::cout << "\nInvalid frame number!" << std::endl;
+                    }
+                    resyncClock(playing);
+                }
+                continue;
+            }
+            
+            switch (key) {             
+                case 's':
+                case 'S':
+                    toggleHud();
+                    break;
+                    
+                case 't':
+                case 'T':
+                    toggleFilmstrip();
+                    break;
+                    
+                case 'f':
+                case 'F':
+                    toggleFitToWindow();
+                    break;
+                    
+                case 'n':
+                case 'N':
+                    jumpToScene(1);
+                    break;
+                    
+                case 'p':
+                case 'P':
+                    jumpToScene(-1);
+                    break;
+                    
+                case '[':
+                    applyCommand({PlayerCommand::Type::Speed, stepPlaybackRate(playbackRate, -1)}, playing, quit);
+                    break;
+                    
+                case ']':
+                    applyCommand({PlayerCommand::Type::Speed, stepPlaybackRate(playbackRate, 1)}, playing, quit);
+                    break;
+                    
+                case 'i':
+                case 'I':
+                    exportIn = currentFrameNumber;
+                    std::cout << "\nExport in: frame " << (exportIn + 1) << std::endl;
+                    break;
+                    
+                case 'o':
+                case 'O':
+                    exportOut = currentFrameNumber;
+                    std::cout << "\nExport out: frame " << (exportOut + 1) << std::endl;
+                    break;
+                    
+                case 'x':
+                case 'X':
+                    startExport();
+                    break;
+                    
+                case 'q':
+                case 'Q':
+                    applyCommand({PlayerCommand::Type::Quit, 0.0}, playing, quit);
+                    break;
+                    
+                case ' ': // SPACE - Play/Pause
+                    applyCommand({PlayerCommand::Type::TogglePause, 0.0}, playing, quit);
+                    break;
+                    
+                case 'd':
+                case 'D':
+                    applyCommand({PlayerCommand::Type::Step, 1.0}, playing, quit);
+                    break;
+                    
+                case 'a':
+                case 'A':
+                    applyCommand({PlayerCommand::Type::Step, -1.0}, playing, quit);
+                    break;
+                    
+                case 'h':
+                case 'H':
+                    applyCommand({PlayerCommand::Type::Seek, 0.0}, playing, quit);
+                    std::cout << "\nJumped to first frame" << std::endl;
+                    break;
+                
+                case 'e':
+                case 'E':
+                    applyCommand({PlayerCommand::Type::Seek, totalFrames - 1.0}, playing, quit);
+                    std::cout << "\nJumped to last frame" << std::endl;
+                    break;
+                    
+                case 'g':
+                case 'G':
+                    // Typed into the window; Enter jumps, ESC cancels
+                    beginFrameEntry();
+                    continue;
+                    
+                default:
+                    if (handleFilterKey(key)) {
+                        break;
+                    }
+                    // No key: the next frame was already fetched on schedule
+                    idle = !playing && !commandsRan && !changed;
+                    continue;
+            }
+            
+            // Any handled key moves the timeline, so restart pacing from the
+            // frame now on screen
+            resyncClock(playing);
+        }
+        
+        audio.stop();
+        controlServer.reset();
+        cv::destroyAllWindows();
+        std::cout << "\nPlayback stopped." << std::endl;
+        std::cout << "Frame cache: " << frameCache.getHits() << " hits, " 
+                  << frameCache.getMisses() << " misses, " 
+                  << frameCache.getFrameCount() << " frames (" 
+                  << (frameCache.getUsedBytes() >> 20) << " MB)" << std::endl;
+        const FrameBufferPool& pool = FrameBufferPool::instance();
+        std::cout << "Frame buffers: " << pool.getHeapAllocations() << " heap allocations, "
+                  << pool.getReuses() << " reuses, "
+                  << (pool.getRetainedBytes() >> 20) << " MB pooled" << std::endl;
+        if (audio.isOpen()) {
+            std::cout << "Audio underruns: " << audio.getUnderruns() << std::endl;
+        }
+        std::cout << "Stage latency p50/p99 (ms):"
+                  << " decode " << stats.decode.percentileMs(50) << "/" << stats.decode.percentileMs(99)
+                  << ", convert " << stats.convert.percentileMs(50) << "/" << stats.convert.percentileMs(99)
+                  << ", overlay " << stats.overlay.percentileMs(50) << "/" << stats.overlay.percentileMs(99)
+                  << ", show " << stats.show.percentileMs(50) << "/" << stats.show.percentileMs(99) 
+                  << std::endl;
+    }
+    
+    /**
+     * Decode every remaining frame through the decode-ahead queue without
+     * presenting them. Returns the number decoded.
+     */
+    int decodeToEnd() {
+        int decoded = 0;
+        while (stepForward(false)) {
+            decoded++;
+        }
+        return decoded;
+    }
+    
+    /**
+     * Headless benchmark of sequential decode, random seeks, backward steps
+     * and the present path (overlay compose/restore; imshow needs a window).
+     * Caches are cleared before each timed seek and step so the numbers are
+     * decode costs. Results are written to 'out' as one JSON object.
+     */
+    void runBenchmark(std::ostream& out, const std::string& filename, int samples = 200) {
+        using Clock = std::chrono::steady_clock;
+        auto elapsedMs = [](Clock::time_point start) {
+            return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        };
+        
+        // Sequential decode through the decode-ahead queue. Large buffer
+        // allocations are counted after a warm-up so the figure reflects
+        // steady-state playback once the pool holds the working set.
+        const FrameBufferPool& pool = FrameBufferPool::instance();
+        const int warmupFrames = decodeAheadFrames * 4;
+        size_t warmAllocations = pool.getHeapAllocations();
+        int decoded = 0;
+        auto start = Clock::now();
+        while (stepForward(false)) {
+            decoded++;
+            if (decoded == warmupFrames) {
+                warmAllocations = pool.getHeapAllocations();
+            }
+        }
+        double sequentialMs = elapsedMs(start);
+        size_t steadyAllocations = decoded > warmupFrames ? pool.getHeapAllocations() - warmAllocations : 0;
+        
+        // Random seeks with a fixed seed so runs are comparable
+        std::mt19937 rng(12345);
+        std::uniform_int_distribution<int> anyFrame(0, std::max(0, totalFrames - 1));
+        std::vector<double> seekMs;
+        for (int i = 0; i < samples; i++) {
+            int target = anyFrame(rng);
+            frameCache.clear();
+            reverseCache.clear();
+            start = Clock::now();
+            if (seekToFrame(target)) {
+                seekMs.push_back(elapsedMs(start));
+            }
+        }
+        
+        // Backward steps from the end, crossing GOP boundaries. Each step
+        // decodes back from its keyframe rather than reading the GOP the
+        // previous step cached.
+        std::vector<double> backwardMs;
+        seekToFrame(totalFrames - 1);
+        for (int i = 0; i < samples; i++) {
+            frameCache.clear();
+            reverseCache.clear();
+            start = Clock::now();
+            if (!previousFrame()) {
+                break;
+            }
+            backwardMs.push_back(elapsedMs(start));
+        }
+        
+        // Present path without the window
+        presentable();
+        std::vector<double> presentMs;
+        for (int i = 0; i < samples; i++) {
+            start = Clock::now();
+            formatOverlayText();
+            drawOverlay();
+            restoreOverlay();
+            presentMs.push_back(elapsedMs(start));
+        }
+        
+        out << "{\n"
+            << "  \"file\": \"" << jsonEscape(filename) << "\",\n"
+            << "  \"resolution\": \"" << currentFrame.cols << "x" << currentFrame.rows << "\",\n"
+            << "  \"total_frames\": " << totalFrames << ",\n"
+            << "  \"decoder\": \"" << jsonEscape(describeDecoder()) << "\",\n"
+            << "  \"startup\": {\"open_ms\": " << openMs << ", \"first_frame_ms\": " << firstFrameMs << "},\n"
+            << "  \"sequential_decode\": {\"frames\": " << decoded 
+            << ", \"fps\": " << (sequentialMs > 0.0 ? decoded * 1000.0 / sequentialMs : 0.0) << "},\n"
+            << "  \"frame_buffers\": {\"steady_state_allocations\": " << steadyAllocations
+            << ", \"heap_allocations\": " << pool.getHeapAllocations()
+            << ", \"reuses\": " << pool.getReuses() 
+            << ", \"pooled_mb\": " << (pool.getRetainedBytes() >> 20) << "},\n";
+        writeLatencyJson(out, "random_seek_ms", seekMs);
+        out << ",\n";
+        writeLatencyJson(out, "backward_step_ms", backwardMs);
+        out << ",\n";
+        writeLatencyJson(out, "present_ms", presentMs);
+        out << ",\n";
+        writeStageJson(out, "stage_decode_ms", stats.decode);
+        out << ",\n";
+        writeStageJson(out, "stage_convert_ms", stats.convert);
+        out << "\n}" << std::endl;
+    }
+    
+    /**
+     * Print the load summary (default) or stay quiet for headless modes
+     */
+    void setVerbose(bool enabled) {
+        verbose = enabled;
+    }
+    
+    /**
+     * Load for decoding only (batch validation): skip the filmstrip and
+     * scene analysis, which run their own threads, and leave the index and
+     * atlas sidecars next to the video untouched. Set before loading.
+     */
+    void setHeadless(bool enabled) {
+        headless = enabled;
+    }
+    
+    /**
+     * Get current frame number (0-based)
+     */
+    int getCurrentFrame() const {
+        return currentFrameNumber;
+    }
+    
+    /**
+     * Get total number of frames
+     */
+    int getTotalFrames() const {
+        return totalFrames;
+    }
+    
+    /**
+     * Select the decoder used by the next loadVideo(); 'device' is the
+     * backend-specific hardware device index, -1 for the default
+     */
+    void setDecodeBackend(DecodeBackend backend, int device = -1) {
+        decodeBackend = backend;
+        hwDevice = device;
+    }
+    
+    /**
+     * Enable the OpenGL window for the next loadVideo(). Combined with a
+     * hardware decode backend, frames stay on the GPU up to presentation.
+     */
+    void setOpenGLDisplay(bool enabled) {
+        useOpenGL = enabled;
+    }
+    
+    /**
+     * Read the next loadVideo() file through a memory mapping with
+     * readahead hints; useful on network-mounted storage
+     */
+    void setMappedInput(bool enabled) {
+        mappedInput = enabled;
+    }
+    
+    /**
+     * Queue a command for the playback loop; safe from any thread and
+     * never waits on presentation
+     */
+    void postCommand(const PlayerCommand& command) {
+        commands.push(command);
+    }
+    
+    /**
+     * Accept control commands on 127.0.0.1:'port' during startPlayback()
+     */
+    void setControlPort(int port) {
+        controlPort = port;
+    }
+    
+    /**
+     * Cache frames packed as I420 until presented, halving the LRU and
+     * reverse cache footprint at the cost of a conversion each way and
+     * 4:2:0 chroma (off by default). Frames played at 1x are unaffected.
+     */
+    void setNativeFrames(bool enabled) {
+        nativeFrames = enabled;
+    }
+    
+    /**
+     * Curve used to bring 10/16-bit sources down to 8 bits for display
+     */
+    void setToneCurve(ToneCurve curve) {
+        toneMapper.setCurve(curve);
+    }
+    
+    /**
+     * Play the file's audio track during playback (on by default)
+     */
+    void setAudioPlayback(bool enabled) {
+        playAudio = enabled;
+    }
+    
+    /**
+     * Analyse scene cuts in the background on the next loadVideo() unless
+     * a cached scene index exists (a cached one is always used)
+     */
+    void setSceneDetection(bool enabled) {
+        analyseScenes = enabled;
+    }
+    
+    /**
+     * Jump to the start of the next (direction > 0) or previous scene
+     */
+    bool jumpToScene(int direction) {
+        if (!sceneIndex.isReady()) {
+            std::cout << "\nScene index not available" 
+                      << (analyseScenes ? " yet (" + std::to_string(sceneIndex.progress()) + "% analysed)" 
+                                        : " (run with --scenes)") << std::endl;
+            return false;
+        }
+        int target = direction > 0 ? sceneIndex.nextScene(currentFrameNumber) 
+                                   : sceneIndex.previousScene(currentFrameNumber);
+        if (target < 0 || !seekToFrame(target)) {
+            std::cout << "\nNo further scene" << std::endl;
+            return false;
+        }
+        return true;
+    }
+    
+    /**
+     * Open a resizable window and decode at its size rather than natively
+     */
+    void setFitToWindow(bool enabled) {
+        fitToWindow = enabled;
+    }
+    
+    /**
+     * Decode ahead as tasks on a shared pool instead of a private thread.
+     * Must be set before loadVideo(); the pool must outlive the player.
+     */
+    void setDecodePool(WorkStealingPool* pool) {
+        decodePool = pool;
+    }
+    
+    /**
+     * Set the window title used by startPlayback()
+     */
+    void setWindowName(const std::string& name) {
+        windowName = name;
+    }
+    
+    /**
+     * Set the byte budget of the decoded-frame LRU cache
+     */
+    void setFrameCacheBudget(size_t bytes) {
+        frameCache.setBudget(bytes);
+    }
+    
+    /**
+     * Decoded-frame cache hits and misses since the video was loaded
+     */
+    size_t getCacheHits() const {
+        return frameCache.getHits();
+    }
+    
+    size_t getCacheMisses() const {
+        return frameCache.getMisses();
+    }
+    
+    /**
+     * Presentation timestamp of the frame on screen in milliseconds
+     */
+    double getCurrentPtsMs() const {
+        return currentPtsMs;
+    }
+    
+    /**
+     * Media time the frame on screen covers: the nominal frame duration,
+     * times the skip stride during fast playback
+     */
+    double getFrameDurationMs() const {
+        return presentedIntervalMs();
+    }
+    
+    /**
+     * The frame on screen as decoded, for measuring: tone mapped if high
+     * bit depth, never filtered here. Exact only with setNativeFrames(false)
+     * and no filter keys handled, as in ComparePlayer.
+     */
+    const cv::Mat& getDecodedFrame() {
+        if (!currentFrameOnGpu && ToneMapper::needsMapping(currentFrame)) {
+            ScopedStageTimer timer(stats.convert);
+            toneMapper.apply(currentFrame, presentScratch);
+            cv::swap(currentFrame, presentScratch);
+        }
+        return currentFrame;
+    }
+    
+    /**
+     * The frame on screen as presented: BGR, tone mapped and filtered,
+     * without the overlay; empty while the frame is GPU-resident
+     */
+    const cv::Mat& getPresentedFrame() {
+        if (!currentFrameOnGpu) {
+            presentable();
+        }
+        return currentFrame;
+    }
+    
+    /**
+     * Window title used for this player
+     */
+    const std::string& getWindowName() const {
+        return windowName;
+    }
+    
+    /**
+     * Frame width in pixels
+     */
+    int getFrameWidth() const {
+        return currentFrame.cols;
+    }
+    
+    /**
+     * Get video FPS
+     */
+    double getFPS() const {
+        return fps;
+    }
+};
+
+/**
+ * Plays several videos side by side in one process. All streams decode on
+ * one shared work-stealing pool and present in lockstep from a single
+ * master clock; keyboard controls act on every stream at once.
+ */
+class MultiStreamPlayer {
+private:
+    using Clock = std::chrono::steady_clock;
+    
+    static constexpr int seekPollMs = 5; // waitKey() timeout while a stream's seek is pending
+    
+    WorkStealingPool decodePool; // Declared first: streams schedule tasks on it
+    std::vector<std::unique_ptr<VideoPlayer>> streams;
+    Clock::time_point masterAnchorTime;
+    double masterAnchorPtsMs;
+    double playbackRate;
+    bool enteringFrame;     // One entry for all streams, so all land on one target
+    std::string frameEntry;
+    
+    /**
+     * Restart the master clock at the earliest frame currently on screen
+     */
+    void anchorMasterClock() {
+        masterAnchorTime = Clock::now();
+        masterAnchorPtsMs = streams.front()->getCurrentPtsMs();
+        for (const auto& stream : streams) {
+            masterAnchorPtsMs = std::min(masterAnchorPtsMs, stream->getCurrentPtsMs());
+        }
+    }
+    
+    double masterClockMs() const {
+        return masterAnchorPtsMs + playbackRate *
+            std::chrono::duration<double, std::milli>(Clock::now() - masterAnchorTime).count();
+    }
+    
+    void printStatus() const {
+        std::cout << "\r";
+        for (size_t i = 0; i < streams.size(); i++) {
+            std::cout << "[" << (i + 1) << "] " << (streams[i]->getCurrentFrame() + 1) 
+                      << "/" << streams[i]->getTotalFrames() << "  ";
+        }
+        std::cout << std::flush;
+    }
+    
+public:
+    MultiStreamPlayer() : decodePool(0), masterAnchorPtsMs(0.0), playbackRate(1.0), enteringFrame(false) {}
+    
+    /**
+     * Add a stream wired to the shared decode pool; configure and load it
+     * through the returned player
+     */
+    VideoPlayer& addStream() {
+        streams.push_back(std::make_unique<VideoPlayer>());
+        VideoPlayer& player = *streams.back();
+        player.setDecodePool(&decodePool);
+        player.setWindowName("Simple Video Player [" + std::to_string(streams.size()) + "]");
+        return player;
+    }
+    
+    /**
+     * Lockstep playback loop with the single-stream key bindings
+     */
+    void startPlayback() {
+        if (streams.empty()) {
+            std::cerr << "No video loaded!" << std::endl;
+            return;
+        }
+        
+        // Lay the windows out left to right
+        int x = 0;
+        for (const auto& stream : streams) {
+            stream->createWindow();
+            cv::moveWindow(stream->getWindowName(), x, 0);
+            x += stream->getFrameWidth();
+        }
+        
+        std::cout << "\n=== Multi-Stream Controls (all " << streams.size() << " streams) ===" << std::endl;
+        std::cout << "SPACE    : Play/Pause" << std::endl;
+        std::cout << "D / A    : Next / previous frame" << std::endl;
+        std::cout << "H / E    : First / last frame" << std::endl;
+        std::cout << "G        : Go to frame (type the number, Enter / ESC)" << std::endl;
+        std::cout << "S        : Toggle stats HUD" << std::endl;
+        std::cout << "F        : Toggle fit to window" << std::endl;
+        std::cout << "[ / ]    : Slower / faster (0.25x-16x)" << std::endl;
+        std::cout << "Q        : Quit" << std::endl;
+        std::cout << "===================================\n" << std::endl;
+        
+        bool playing = false;
+        bool quit = false;
+        
+        while (!quit) {
+            for (const auto& stream : streams) {
+                stream->displayFrame();
+            }
+            printStatus();
+            
+            // Every stream shows the frame covering the master clock; sleep
+            // until the earliest next frame is due
+            int delay = 0;
+            if (playing) {
+                double master = masterClockMs();
+                double nextDueMs = 0.0;
+                bool anyRunning = false;
+                for (const auto& stream : streams) {
+                    if (stream->isSeekPending()) {
+                        anyRunning = true; // Shows its stand-in until the target lands
+                        continue;
+                    }
+                    if (stream->advanceToTime(master)) {
+                        double dueMs = stream->getCurrentPtsMs() + stream->getFrameDurationMs();
+                        nextDueMs = anyRunning ? std::min(nextDueMs, dueMs) : dueMs;
+                        anyRunning = true;
+                    }
+                }
+                if (anyRunning) {
+                    delay = std::max(1, static_cast<int>((nextDueMs - masterClockMs()) / playbackRate));
+                } else {
+                    std::cout << "\nEnd of all streams reached" << std::endl;
+                    playing = false;
+                }
+            }
+            
+            // Hold the stand-ins on screen until every seek target lands
+            for (const auto& stream : streams) {
+                if (stream->isSeekPending() && (delay == 0 || delay > seekPollMs)) {
+                    delay = seekPollMs;
+                }
+            }
+            int key = cv::waitKey(delay) & 0xFF;
+            bool seeksLanded = false;
+            for (const auto& stream : streams) {
+                stream->refitToWindow();
+                seeksLanded = stream->pollSeek() || seeksLanded;
+            }
+            if (seeksLanded) {
+                anchorMasterClock();
+            }
+            
+            // One frame entry, as long as the longest stream allows, sent
+            // to every stream; each seeks asynchronously as in single-stream
+            // mode. Streams too short for the target keep their frame.
+            if (enteringFrame && key != 0xFF) {
+                size_t maxDigits = 1;
+                for (const auto& stream : streams) {
+                    maxDigits = std::max(maxDigits, std::to_string(stream->getTotalFrames()).size());
+                }
+                VideoPlayer::EntryKey result = VideoPlayer::editFrameEntry(frameEntry, key, maxDigits);
+                if (result == VideoPlayer::EntryKey::Edited) {
+                    for (const auto& stream : streams) {
+                        stream->showFrameEntry(frameEntry);
+                    }
+                } else if (result != VideoPlayer::EntryKey::Ignored) {
+                    enteringFrame = false;
+                    int targetFrame = VideoPlayer::frameEntryTarget(frameEntry);
+                    for (const auto& stream : streams) {
+                        stream->endFrameEntry();
+                        if (result == VideoPlayer::EntryKey::Finished) {
+                            stream->beginSeek(targetFrame);
+                        }
+                    }
+                    if (result == VideoPlayer::EntryKey::Finished) {
+                        anchorMasterClock();
+                    }
+                }
+                continue;
+            }
+            
+            switch (key) {
+                case 'q':
+                case 'Q':
+                    quit = true;
+                    break;
+                    
+                case ' ':
+                    playing = !playing;
+                    std::cout << "\n" << (playing ? "▶ Playing" : "⏸ Paused") << std::endl;
+                    break;
+                    
+                case 'd':
+                case 'D':
+                    for (const auto& stream : streams) {
+                        stream->nextFrame();
+                    }
+                    break;
+                    
+                case 'a':
+                case 'A':
+                    for (const auto& stream : streams) {
+                        stream->previousFrame();
+                    }
+                    break;
+                    
+                case 'h':
+                case 'H':
+                    for (const auto& stream : streams) {
+                        stream->seekToFrame(0);
+                    }
+                    break;
+                    
+                case 'e':
+                case 'E':
+                    for (const auto& stream : streams) {
+                        stream->seekToFrame(stream->getTotalFrames() - 1);
+                    }
+                    break;
+                    
+                case 'g':
+                case 'G':
+                    enteringFrame = true;
+                    frameEntry.clear();
+                    for (const auto& stream : streams) {
+                        stream->showFrameEntry(frameEntry);
+                    }
+                    continue;
+                    
+                case 's':
+                case 'S':
+                    for (const auto& stream : streams) {
+                        stream->toggleHud();
+                    }
+                    break;
+                    
+                case 'f':
+                case 'F':
+                    for (const auto& stream : streams) {
+                        stream->toggleFitToWindow();
+                    }
+                    break;
+                    
+                case '[':
+                case ']':
+                    playbackRate = stepPlaybackRate(playbackRate, key == ']' ? 1 : -1);
+                    for (const auto& stream : streams) {
+                        stream->setPlaybackRate(playbackRate);
+                    }
+                    break;
+                    
+                default: {
+                    bool handled = false;
+                    for (const auto& stream : streams) {
+                        handled = stream->handleFilterKey(key) || handled;
+                    }
+                    if (handled) {
+                        break;
+                    }
+                    continue;
+                }
+            }
+            
+            anchorMasterClock();
+        }
+        
+        cv::destroyAllWindows();
+        std::cout << "\nPlayback stopped." << std::endl;
+    }
+};
+
+/**
+ * Encoder QA view: a rendition stepped in lockstep with its reference
+ * through the players' own nextFrame() / previousFrame() / seekToFrame(),
+ * shown in one window either split (reference left of a divider that
+ * follows the mouse) or as an amplified difference. PSNR and SSIM of each
+ * frame pair shown, as decoded (never I420-cached or filtered), are
+ * computed on a worker pool off the UI thread, and
+ * can be written out as CSV. A rendition of another resolution is scaled
+ * to the reference size before comparing.
+ */
+class ComparePlayer {
+public:
+    enum class View {
+        Split,     // Reference left of the divider, rendition right
+        Difference // |reference - rendition|, amplified
+    };
+    
+private:
+    using Clock = std::chrono::steady_clock;
+    
+    struct FrameMetrics {
+        double psnr;
+        double ssim;
+        bool ready; // False while the pool is still measuring
+    };
+    
+    static constexpr double differenceGain = 4.0; // Makes small coding errors visible
+    static constexpr int uiPollMs = 15;           // Redraw check while paused
+    
+    WorkStealingPool decodePool; // Declared first: the players schedule tasks on it
+    VideoPlayer reference;
+    VideoPlayer rendition;
+    std::string windowName;
+    View view;
+    int splitX;                  // Divider in frame pixels; -1 for the middle
+    int totalFrames;             // Frames both files have
+    double playbackRate;
+    bool dirty;                  // Window content out of date
+    cv::Mat renditionScaled;     // Rendition at the reference size
+    cv::Mat canvas;
+    
+    mutable std::mutex metricsMutex;
+    std::map<int, FrameMetrics> metrics; // By frame number
+    std::atomic<size_t> inFlight;
+    size_t skippedFrames;        // Stepped past during playback while the pool was behind
+    WorkStealingPool metricsPool; // Declared last: destroyed first, so tasks finish before the rest
+    
+    static void onMouse(int event, int x, int, int, void* userdata) {
+        ComparePlayer* player = static_cast<ComparePlayer*>(userdata);
+        if (event == cv::EVENT_MOUSEMOVE && player->view == View::Split && x != player->splitX) {
+            player->splitX = x;
+            player->dirty = true;
+        }
+    }
+    
+    /**
+     * The rendition frame on screen, at the reference frame's size
+     */
+    const cv::Mat& alignedRendition() {
+        const cv::Mat& frame = rendition.getDecodedFrame();
+        cv::Size size = reference.getDecodedFrame().size();
+        if (frame.empty() || frame.size() == size) {
+            return frame;
+        }
+        cv::resize(frame, renditionScaled, size, 0, 0, cv::INTER_CUBIC);
+        return renditionScaled;
+    }
+    
+    /**
+     * Put the rendition back on the reference's frame if a step or seek
+     * left them apart (a decode error on one side)
+     */
+    void keepInStep() {
+        int frameNumber = reference.getCurrentFrame();
+        if (rendition.getCurrentFrame() != frameNumber) {
+            rendition.seekToFrame(frameNumber);
+        }
+        dirty = true;
+    }
+    
+    bool stepForward() {
+        if (reference.getCurrentFrame() + 1 >= totalFrames) {
+            return false;
+        }
+        bool ok = reference.nextFrame() && rendition.nextFrame();
+        keepInStep();
+        return ok;
+    }
+    
+    bool stepBackward() {
+        bool ok = reference.previousFrame() && rendition.previousFrame();
+        keepInStep();
+        return ok;
+    }
+    
+    bool seek(int frameNumber) {
+        if (frameNumber < 0 || frameNumber >= totalFrames) {
+            return false;
+        }
+        bool ok = reference.seekToFrame(frameNumber) && rendition.seekToFrame(frameNumber);
+        keepInStep();
+        return ok;
+    }
+    
+    /**
+     * Queue the metrics of the frame pair on screen unless known or
+     * queued. While playing, a pool already two frames per worker behind
+     * skips the frame rather than fall further behind.
+     */
+    void measureCurrentFrame(bool playing) {
+        int frameNumber = reference.getCurrentFrame();
+        {
+            std::lock_guard<std::mutex> lock(metricsMutex);
+            if (metrics.count(frameNumber)) {
+                return;
+            }
+        }
+        if (playing && inFlight >= 2 * metricsPool.size()) {
+            skippedFrames++;
+            return;
+        }
+        const cv::Mat& referenceFrame = reference.getDecodedFrame();
+        const cv::Mat& renditionFrame = alignedRendition();
+        if (referenceFrame.empty() || renditionFrame.type() != referenceFrame.type()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(metricsMutex);
+            metrics[frameNumber] = {0.0, 0.0, false};
+        }
+        inFlight++;
+        cv::Mat a = referenceFrame.clone();
+        cv::Mat b = renditionFrame.clone();
+        metricsPool.submit([this, frameNumber, a, b] {
+            cv::Mat lumaA, lumaB;
+            cv::cvtColor(a, lumaA, cv::COLOR_BGR2GRAY);
+            cv::cvtColor(b, lumaB, cv::COLOR_BGR2GRAY);
+            FrameMetrics result = {QualityMetrics::psnr(a, b), QualityMetrics::ssim(lumaA, lumaB), true};
+            {
+                std::lock_guard<std::mutex> lock(metricsMutex);
+                metrics[frameNumber] = result;
+            }
+            inFlight--;
+        });
+    }
+    
+    bool currentMetrics(FrameMetrics& result) const {
+        std::lock_guard<std::mutex> lock(metricsMutex);
+        auto it = metrics.find(reference.getCurrentFrame());
+        if (it == metrics.end() || !it->second.ready) {
+            return false;
+        }
+        result = it->second;
+        return true;
+    }
+    
+    void waitForMetrics() const {
+        while (inFlight > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    
+    static std::string formatPsnr(double psnr) {
+        if (std::isinf(psnr)) {
+            return "inf";
+        }
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.4f", psnr);
+        return text;
+    }
+    
+    void render() {
+        const cv::Mat& referenceFrame = reference.getDecodedFrame();
+        const cv::Mat& renditionFrame = alignedRendition();
+        if (referenceFrame.empty() || renditionFrame.type() != referenceFrame.type()) {
+            return;
+        }
+        
+        if (view == View::Difference) {
+            cv::absdiff(referenceFrame, renditionFrame, canvas);
+            canvas.convertTo(canvas, -1, differenceGain);
+        } else {
+            referenceFrame.copyTo(canvas);
+            int x = splitX < 0 ? canvas.cols / 2 : std::min(splitX, canvas.cols);
+            cv::Rect right(x, 0, canvas.cols - x, canvas.rows);
+            renditionFrame(right).copyTo(canvas(right));
+            cv::line(canvas, cv::Point(x, 0), cv::Point(x, canvas.rows - 1), cv::Scalar(255, 255, 255), 1);
+        }
+        
+        FrameMetrics shown;
+        std::string text = "Frame: " + std::to_string(reference.getCurrentFrame() + 1) + "/" + 
+                           std::to_string(totalFrames);
+        if (reference.isEnteringFrame()) {
+            text = "Go to frame: " + reference.getFrameEntry() + "_";
+        } else if (currentMetrics(shown)) {
+            char values[64];
+            if (std::isinf(shown.psnr)) {
+                std::snprintf(values, sizeof(values), "  PSNR inf  SSIM %.4f", shown.ssim);
+            } else {
+                std::snprintf(values, sizeof(values), "  PSNR %.2f dB  SSIM %.4f", shown.psnr, shown.ssim);
+            }
+            text += values;
+        } else {
+            text += "  measuring...";
+        }
+        cv::putText(canvas, text, cv::Point(10, 30), cv::FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(0, 255, 0), 2);
+        if (view == View::Difference) {
+            cv::putText(canvas, "difference x" + std::to_string(static_cast<int>(differenceGain)), 
+                        cv::Point(10, 60), cv::FONT_HERSHEY_SIMPLEX, 0.6, 
+                        cv::Scalar(0, 255, 0), 1);
+        }
+        cv::imshow(windowName, canvas);
+        dirty = false;
+    }
+    
+    void printSummary() const {
+        std::lock_guard<std::mutex> lock(metricsMutex);
+        double psnrSum = 0.0, ssimSum = 0.0;
+        size_t measured = 0, finite = 0;
+        for (const auto& entry : metrics) {
+            if (!entry.second.ready) {
+                continue;
+            }
+            measured++;
+            ssimSum += entry.second.ssim;
+            if (!std::isinf(entry.second.psnr)) {
+                psnrSum += entry.second.psnr;
+                finite++;
+            }
+        }
+        if (measured == 0) {
+            return;
+        }
+        std::cout << "\nCompared " << measured << " frames";
+        if (skippedFrames > 0) {
+            std::cout << " (" << skippedFrames << " skipped during playback)";
+        }
+        std::cout << ": mean PSNR " << std::fixed << std::setprecision(2) 
+                  << (finite ? psnrSum / finite : std::numeric_limits<double>::infinity()) << " dB"
+                  << ", mean SSIM " << std::setprecision(4) << ssimSum / measured << std::endl;
+    }
+    
+public:
+    ComparePlayer() : decodePool(0), windowName("Simple Video Player - Compare"), view(View::Split), 
+                      splitX(-1), totalFrames(0), playbackRate(1.0), dirty(true), inFlight(0), 
+                      skippedFrames(0), metricsPool(0) {
+        reference.setDecodePool(&decodePool);
+        rendition.setDecodePool(&decodePool);
+        rendition.setVerbose(false);
+    }
+    
+    /**
+     * Players for per-stream settings before load()
+     */
+    VideoPlayer& getReference() {
+        return reference;
+    }
+    
+    VideoPlayer& getRendition() {
+        return rendition;
+    }
+    
+    /**
+     * Open both files; comparison covers the frames both have
+     */
+    bool load(const std::string& referenceFile, const std::string& renditionFile) {
+        // Measure what the decoder delivered, not the player's I420 cache copies
+        reference.setNativeFrames(false);
+        rendition.setNativeFrames(false);
+        if (!reference.loadVideo(referenceFile)) {
+            std::cerr << "Failed to load reference: " << referenceFile << std::endl;
             return false;
         }
-        
-        cap.set(cv::CAP_PROP_POS_FRAMES, frameNumber);
-        
-        if (cap.read(currentFrame)) {
-            currentFrameNumber = frameNumber;
-            return true;
+        if (!rendition.loadVideo(renditionFile)) {
+            std::cerr << "Failed to load rendition: " << renditionFile << std::endl;
+            return false;
         }
-        return false;
+        totalFrames = std::min(reference.getTotalFrames(), rendition.getTotalFrames());
+        if (reference.getTotalFrames() != rendition.getTotalFrames()) {
+            std::cerr << "Warning: frame counts differ (" << reference.getTotalFrames() << " vs " 
+                      << rendition.getTotalFrames() << "); comparing the first " << totalFrames << std::endl;
+        }
+        metrics.clear();
+        skippedFrames = 0;
+        dirty = true;
+        return totalFrames > 0;
     }
     
     /**
-     * Display current frame in window
+     * Write the metrics of every frame compared so far, in frame order:
+     * frame (1-based), PSNR in dB ("inf" for identical frames), SSIM.
+     * After measureAll() that is every frame both files have.
      */
-    void displayFrame() {
-        if (!currentFrame.empty()) {
-            // Add frame info overlay
-            cv::Mat displayFrame = currentFrame.clone();
-            std::string info = "Frame: " + std::to_string(currentFrameNumber + 1) + 
-                              "/" + std::to_string(totalFrames);
-            cv::putText(displayFrame, info, cv::Point(10, 30), 
-                       cv::FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(0, 255, 0), 2);
-            
-            cv::imshow(windowName, displayFrame);
+    bool writeCsv(const std::string& path) const {
+        waitForMetrics();
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "Cannot write metrics to " << path << std::endl;
+            return false;
         }
+        out << "frame,psnr_db,ssim\n";
+        std::lock_guard<std::mutex> lock(metricsMutex);
+        for (const auto& entry : metrics) {
+            if (entry.second.ready) {
+                out << (entry.first + 1) << "," << formatPsnr(entry.second.psnr) << "," 
+                    << std::fixed << std::setprecision(6) << entry.second.ssim << "\n";
+            }
+        }
+        return static_cast<bool>(out);
     }
     
     /**
-     * Print current frame information
+     * Headless run (--metrics-csv): measure every frame pair both files
+     * have, in order and without a window. Decoding waits for the pool
+     * instead of skipping frames. False if stepping failed before the end.
      */
-    void printFrameInfo() {
-        double progress = (double)(currentFrameNumber + 1) / totalFrames * 100.0;
-        std::cout << "\rFrame: " << (currentFrameNumber + 1) << "/" << totalFrames 
-                  << " (" << std::fixed << std::setprecision(1) << progress << "%)" 
-                  << std::flush;
+    bool measureAll() {
+        if (totalFrames == 0) {
+            std::cerr << "No video loaded!" << std::endl;
+            return false;
+        }
+        bool ok = reference.getCurrentFrame() == 0 || seek(0);
+        while (ok) {
+            while (inFlight >= 2 * metricsPool.size()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            measureCurrentFrame(false);
+            int frameNumber = reference.getCurrentFrame();
+            std::cout << "\rCompare: " << (frameNumber + 1) << "/" << totalFrames << " frames" << std::flush;
+            if (frameNumber + 1 >= totalFrames) {
+                break;
+            }
+            ok = stepForward();
+        }
+        std::cout << std::endl;
+        if (!ok) {
+            std::cerr << "Comparison stopped at frame " << (reference.getCurrentFrame() + 1) << std::endl;
+        }
+        waitForMetrics();
+        printSummary();
+        return ok;
     }
     
     /**
-     * Main playback loop with controls
+     * Interactive loop; playback paces both streams at the reference's
+     * frame rate
      */
     void startPlayback() {
-        if (currentFrame.empty()) {
+        if (totalFrames == 0) {
             std::cerr << "No video loaded!" << std::endl;
             return;
         }
-        
         cv::namedWindow(windowName, cv::WINDOW_AUTOSIZE);
+        cv::setMouseCallback(windowName, &ComparePlayer::onMouse, this);
         
-        // Show controls
-        std::cout << "\n=== Simple Video Player Controls ===" << std::endl;
+        std::cout << "\n=== Compare Controls ===" << std::endl;
         std::cout << "SPACE    : Play/Pause" << std::endl;
-        std::cout << "→ or D   : Next frame" << std::endl;
-        std::cout << "← or A   : Previous frame" << std::endl;
-        std::cout << "HOME     : Go to first frame" << std::endl;
-        std::cout << "END      : Go to last frame" << std::endl;
-        std::cout << "G        : Go to specific frame" << std::endl;
-        std::cout << "ESC or Q : Quit" << std::endl;
-        std::cout << "===================================\n" << std::endl;
+        std::cout << "D / A    : Next / previous frame" << std::endl;
+        std::cout << "H / E    : First / last frame" << std::endl;
+        std::cout << "G        : Go to frame (type the number, Enter / ESC)" << std::endl;
+        std::cout << "V        : Split / difference view (mouse moves the split)" << std::endl;
+        std::cout << "[ / ]    : Slower / faster (0.25x-16x)" << std::endl;
+        std::cout << "Q        : Quit" << std::endl;
+        std::cout << "========================\n" << std::endl;
         
         bool playing = false;
         bool quit = false;
+        bool shownReady = false;
+        Clock::time_point nextDue = Clock::now();
         
         while (!quit) {
-            displayFrame();
-            printFrameInfo();
+            measureCurrentFrame(playing);
+            FrameMetrics unused;
+            bool ready = currentMetrics(unused);
+            if (dirty || ready != shownReady) {
+                render();
+                shownReady = ready;
+            }
             
-            // Wait for key input (33ms = ~30fps when playing, 0 = wait indefinitely when paused)
-            int key = cv::waitKey(playing ? 33 : 0) & 0xFF;
+            int delay = uiPollMs;
+            if (playing) {
+                delay = std::max(1, static_cast<int>(
+                    std::chrono::duration_cast<std::chrono::milliseconds>(nextDue - Clock::now()).count()));
+            }
+            int key = cv::waitKey(delay) & 0xFF;
             
-            switch (key) {             
+            if (reference.isEnteringFrame() && key != 0xFF) {
+                int targetFrame;
+                if (reference.frameEntryKey(key, targetFrame)) {
+                    seek(targetFrame);
+                }
+                dirty = true;
+                continue;
+            }
+            
+            switch (key) {
+                case 0xFF: // Timeout
+                    if (playing && Clock::now() >= nextDue) {
+                        auto interval = std::chrono::duration_cast<Clock::duration>(
+                            std::chrono::duration<double, std::milli>(reference.getFrameDurationMs() / playbackRate));
+                        // Late (decode behind): restart the pace rather than rush
+                        nextDue = std::max(nextDue + interval, Clock::now());
+                        if (!stepForward()) {
+                            std::cout << "\nEnd of video reached" << std::endl;
+                            playing = false;
+                        }
+                    }
+                    break;
+                    
                 case 'q':
                 case 'Q':
                     quit = true;
                     break;
                     
-                case ' ': // SPACE - Play/Pause
+                case ' ':
                     playing = !playing;
+                    nextDue = Clock::now();
                     std::cout << "\n" << (playing ? "▶ Playing" : "⏸ Paused") << std::endl;
                     break;
                     
                 case 'd':
                 case 'D':
-                    if (!nextFrame()) {
-                        std::cout << "\nEnd of video reached" << std::endl;
-                        playing = false;
-                    }
+                    stepForward();
                     break;
                     
                 case 'a':
                 case 'A':
-                    if (!previousFrame()) {
-                        std::cout << "\nBeginning of video reached" << std::endl;
-                    }
+                    stepBackward();
                     break;
                     
                 case 'h':
                 case 'H':
-                    seekToFrame(0);
-                    std::cout << "\nJumped to first frame" << std::endl;
+                    seek(0);
                     break;
-                
+                    
                 case 'e':
                 case 'E':
-                    seekToFrame(totalFrames - 1);
-                    std::cout << "\nJumped to last frame" << std::endl;
+                    seek(totalFrames - 1);
                     break;
                     
                 case 'g':
-                case 'G': {
-                    std::cout << "\nEnter frame number (1-" << totalFrames << "): ";
-                    int targetFrame;
-                    std::cin >> targetFrame;
-                    
-                    if (targetFrame >= 1 && targetFrame <= totalFrames) {
-                        seekToFrame(targetFrame - 1); // Convert to 0-based
-                        std::cout << "Jumped to frame " << targetFrame << std::endl;
-                    } else {
-                        std::cout << "Invalid frame number!" << std::endl;
-                    }
+                case 'G':
+                    reference.beginFrameEntry();
+                    dirty = true;
+                    break;
+                    
+                case 'v':
+                case 'V':
+                    view = view == View::Split ? View::Difference : View::Split;
+                    dirty = true;
+                    break;
+                    
+                case '[':
+                case ']':
+                    playbackRate = stepPlaybackRate(playbackRate, key == ']' ? 1 : -1);
+                    std::cout << "\nSpeed: " << playbackRate << "x" << std::endl;
                     break;
-                }
                     
                 default:
-                    // Auto-advance when playing
-                    if (playing) {
-                        if (!nextFrame()) {
-                            std::cout << "\nEnd of video reached" << std::endl;
-                            playing = false;
-                        }
-                    }
                     break;
             }
         }
         
+        waitForMetrics();
         cv::destroyAllWindows();
+        printSummary();
         std::cout << "\nPlayback stopped." << std::endl;
     }
+};
+
+/**
+ * Adaptive playout buffer for live sources. Each frame is scheduled at
+ * anchor + (pts - anchorPts) + delay; 'delay' follows the interarrival
+ * jitter (RFC 3550 estimator), so a steady network runs close to one frame
+ * of latency and a bursty one buffers just enough to play smoothly. On
+ * overflow, or in low-latency mode, older frames are skipped in favour of
+ * the newest. Popped buffers are recycled to the receiver.
+ */
+class JitterBuffer {
+public:
+    using Clock = std::chrono::steady_clock;
+    
+    struct Stats {
+        size_t frames;
+        double delayMs;
+        double jitterMs;
+        int skippedFrames;
+    };
+    
+private:
+    struct Entry {
+        cv::Mat image;
+        double ptsMs;
+    };
+    
+    static constexpr double maxDelayMs = 1000.0;
+    static constexpr size_t maxFrames = 120;
+    
+    std::deque<Entry> entries;
+    std::vector<cv::Mat> spares;
+    double frameDurationMs;
+    bool lowLatency;
+    
+    // Playout clock and jitter state, updated on push()
+    bool started;
+    bool anchored;
+    Clock::time_point anchorTime;
+    double anchorPtsMs;
+    double lastPtsMs;
+    Clock::time_point lastArrival;
+    double jitterMs;
+    int skippedFrames;
+    mutable std::mutex mutex;
+    
+    double delayMsLocked() const {
+        return lowLatency ? 0.0 : std::clamp(frameDurationMs + 4.0 * jitterMs, frameDurationMs, maxDelayMs);
+    }
+    
+    Clock::time_point dueLocked(double ptsMs) const {
+        return anchorTime + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double, std::milli>(ptsMs - anchorPtsMs + delayMsLocked()));
+    }
+    
+    void skipToNewestLocked() {
+        while (entries.size() > 1) {
+            spares.push_back(std::move(entries.front().image));
+            entries.pop_front();
+            skippedFrames++;
+        }
+    }
+    
+public:
+    explicit JitterBuffer(double frameDurationMs) 
+        : frameDurationMs(frameDurationMs), lowLatency(false), started(false), anchored(false),
+          anchorPtsMs(0.0), lastPtsMs(0.0), jitterMs(0.0), skippedFrames(0) {}
+    
+    void setLowLatency(bool enabled) {
+        std::lock_guard<std::mutex> lock(mutex);
+        lowLatency = enabled;
+        anchored = false;
+    }
+    
+    bool isLowLatency() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return lowLatency;
+    }
     
     /**
-     * Get current frame number (0-based)
+     * Nominal frame rate once the source reports one
      */
-    int getCurrentFrame() const {
-        return currentFrameNumber;
+    void setFrameRate(double fps) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (fps > 0.0 && fps <= 240.0) {
+            frameDurationMs = 1000.0 / fps;
+        }
     }
     
     /**
-     * Get total number of frames
+     * A recycled buffer to decode the next frame into
      */
-    int getTotalFrames() const {
-        return totalFrames;
+    cv::Mat acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (spares.empty()) {
+            return cv::Mat();
+        }
+        cv::Mat image = std::move(spares.back());
+        spares.pop_back();
+        return image;
     }
     
     /**
-     * Get video FPS
+     * Queue a frame that just arrived. A timestamp that goes backwards or
+     * jumps by more than the maximum delay (missing or reset timestamps,
+     * e.g. after a reconnect) is replaced by the next nominal one.
      */
-    double getFPS() const {
-        return fps;
+    void push(cv::Mat&& image, double ptsMs) {
+        Clock::time_point arrival = Clock::now();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (started && (ptsMs <= lastPtsMs || ptsMs - lastPtsMs > maxDelayMs)) {
+            ptsMs = lastPtsMs + frameDurationMs;
+        }
+        
+        if (started) {
+            // Interarrival jitter: deviation of arrival spacing from PTS spacing
+            double arrivalMs = std::chrono::duration<double, std::milli>(arrival - lastArrival).count();
+            double deviation = std::abs(arrivalMs - (ptsMs - lastPtsMs));
+            jitterMs += (deviation - jitterMs) / 16.0;
+        }
+        
+        // (Re)anchor on the first frame, or when the frame arrives so late
+        // that the clocks drifted apart, so playout follows the source
+        if (!anchored || arrival > dueLocked(ptsMs) + std::chrono::milliseconds(static_cast<int>(maxDelayMs))) {
+            anchored = true;
+            anchorTime = arrival;
+            anchorPtsMs = ptsMs;
+        }
+        started = true;
+        lastPtsMs = ptsMs;
+        lastArrival = arrival;
+        
+        entries.push_back(Entry{std::move(image), ptsMs});
+        if (lowLatency || entries.size() > maxFrames) {
+            skipToNewestLocked();
+            if (!lowLatency) {
+                anchorTime = arrival; // Restart playout from the newest frame
+                anchorPtsMs = ptsMs;
+            }
+        }
+    }
+    
+    /**
+     * Swap the oldest frame whose playout time has come into 'image'.
+     * Otherwise returns false and sets 'waitMs' to the time until the next
+     * frame is due (or a short poll interval when the buffer is empty).
+     */
+    bool pop(cv::Mat& image, double& ptsMs, int& waitMs) {
+        std::lock_guard<std::mutex> lock(mutex);
+        waitMs = 5;
+        if (entries.empty()) {
+            return false;
+        }
+        Clock::time_point now = Clock::now();
+        Clock::time_point due = dueLocked(entries.front().ptsMs);
+        if (due > now && !lowLatency) {
+            waitMs = std::max(1, static_cast<int>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(due - now).count()));
+            return false;
+        }
+        std::swap(image, entries.front().image);
+        ptsMs = entries.front().ptsMs;
+        spares.push_back(std::move(entries.front().image));
+        entries.pop_front();
+        return true;
+    }
+    
+    /**
+     * Drop everything queued except the newest frame (e.g. after a pause)
+     */
+    void skipToNewest() {
+        std::lock_guard<std::mutex> lock(mutex);
+        skipToNewestLocked();
+        anchored = false;
+    }
+    
+    Stats getStats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return Stats{entries.size(), delayMsLocked(), jitterMs, skippedFrames};
+    }
+};
+
+/**
+ * Player for live network sources (RTSP, HTTP, HLS, ...), which have no
+ * frame count, cannot seek and may drop out. A receiver thread owns the
+ * capture and feeds a JitterBuffer; when the connection fails it reopens
+ * with backoff in the background, so the window keeps responding and
+ * shows the last frame until the stream is back.
+ */
+class LiveStreamPlayer {
+private:
+    static constexpr int openTimeoutMs = 5000;
+    static constexpr int maxReconnectDelayMs = 8000;
+    
+    std::string url;
+    std::string windowName;
+    JitterBuffer buffer;
+    std::thread receiver;
+    std::mutex stateMutex;
+    std::condition_variable stopRequested;
+    bool stopping;
+    std::atomic<bool> connected;
+    std::atomic<int> reconnects;
+    
+    bool openStream(cv::VideoCapture& capture) {
+        std::vector<int> params = {cv::CAP_PROP_OPEN_TIMEOUT_MSEC, openTimeoutMs,
+                                   cv::CAP_PROP_READ_TIMEOUT_MSEC, openTimeoutMs};
+        return capture.open(url, cv::CAP_FFMPEG, params) || capture.open(url);
+    }
+    
+    /**
+     * Sleep up to 'ms' unless stop() is called; returns false if stopping
+     */
+    bool waitUnlessStopping(int ms) {
+        std::unique_lock<std::mutex> lock(stateMutex);
+        return !stopRequested.wait_for(lock, std::chrono::milliseconds(ms), [this] { return stopping; });
+    }
+    
+    void receiveLoop() {
+        cv::VideoCapture capture;
+        int reconnectDelayMs = 250;
+        while (waitUnlessStopping(0)) {
+            if (!capture.isOpened()) {
+                if (!openStream(capture)) {
+                    // Back off exponentially while the source is unreachable
+                    if (!waitUnlessStopping(reconnectDelayMs)) {
+                        break;
+                    }
+                    reconnectDelayMs = std::min(reconnectDelayMs * 2, maxReconnectDelayMs);
+                    continue;
+                }
+                reconnectDelayMs = 250;
+                buffer.setFrameRate(capture.get(cv::CAP_PROP_FPS));
+                connected = true;
+            }
+            
+            cv::Mat frame = buffer.acquire();
+            if (!capture.read(frame)) {
+                capture.release();
+                connected = false;
+                reconnects++;
+                continue;
+            }
+            buffer.push(std::move(frame), capture.get(cv::CAP_PROP_POS_MSEC));
+        }
+    }
+    
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            stopping = true;
+        }
+        stopRequested.notify_all();
+        if (receiver.joinable()) {
+            receiver.join(); // At most one read timeout
+        }
+    }
+    
+    void drawStatus(cv::Mat& frame, bool showHud) const {
+        JitterBuffer::Stats stats = buffer.getStats();
+        std::string status = connected ? "LIVE" : "RECONNECTING";
+        cv::putText(frame, status, cv::Point(10, 30), cv::FONT_HERSHEY_SIMPLEX, 1, 
+                    connected ? cv::Scalar(0, 255, 0) : cv::Scalar(0, 0, 255), 2);
+        if (showHud) {
+            char hud[160];
+            std::snprintf(hud, sizeof(hud), 
+                          "buffer %d frames  delay %.0f ms  jitter %.1f ms  skipped %d  reconnects %d%s",
+                          static_cast<int>(stats.frames), stats.delayMs, stats.jitterMs, 
+                          stats.skippedFrames, reconnects.load(), 
+                          buffer.isLowLatency() ? "  low latency" : "");
+            cv::putText(frame, hud, cv::Point(10, 60), cv::FONT_HERSHEY_SIMPLEX, 0.6, cv::Scalar(0, 255, 0), 1);
+        }
+    }
+    
+public:
+    explicit LiveStreamPlayer(const std::string& url, double expectedFps = 30.0) 
+        : url(url), windowName("Simple Video Player - " + url), buffer(1000.0 / expectedFps),
+          stopping(false), connected(false), reconnects(0) {}
+    
+    ~LiveStreamPlayer() {
+        stop();
+    }
+    
+    void setLowLatency(bool enabled) {
+        buffer.setLowLatency(enabled);
+    }
+    
+    /**
+     * Receive in the background and present from the jitter buffer until
+     * the user quits
+     */
+    void startPlayback() {
+        receiver = std::thread(&LiveStreamPlayer::receiveLoop, this);
+        cv::namedWindow(windowName, cv::WINDOW_AUTOSIZE);
+        
+        std::cout << "\n=== Live Stream Controls ===" << std::endl;
+        std::cout << "SPACE    : Pause / resume (resumes at the newest frame)" << std::endl;
+        std::cout << "L        : Toggle low-latency mode" << std::endl;
+        std::cout << "S        : Toggle stats HUD" << std::endl;
+        std::cout << "Q        : Quit" << std::endl;
+        std::cout << "============================\n" << std::endl;
+        
+        cv::Mat frame;
+        double ptsMs = 0.0;
+        bool paused = false;
+        bool showHud = false;
+        bool quit = false;
+        while (!quit) {
+            int waitMs = 5;
+            if (!paused && buffer.pop(frame, ptsMs, waitMs)) {
+                drawStatus(frame, showHud);
+                cv::imshow(windowName, frame);
+                waitMs = 1;
+            } else if (!connected && !frame.empty()) {
+                // Keep the last frame up and mark it stale
+                drawStatus(frame, showHud);
+                cv::imshow(windowName, frame);
+            }
+            
+            int key = cv::waitKey(waitMs) & 0xFF;
+            switch (key) {
+                case 'q':
+                case 'Q':
+                    quit = true;
+                    break;
+                    
+                case ' ':
+                    paused = !paused;
+                    if (!paused) {
+                        buffer.skipToNewest();
+                    }
+                    std::cout << "\n" << (paused ? "⏸ Paused" : "▶ Live") << std::endl;
+                    break;
+                    
+                case 'l':
+                case 'L':
+                    buffer.setLowLatency(!buffer.isLowLatency());
+                    std::cout << "\nLow latency: " << (buffer.isLowLatency() ? "on" : "off") << std::endl;
+                    break;
+                    
+                case 's':
+                case 'S':
+                    showHud = !showHud;
+                    break;
+            }
+        }
+        
+        stop();
+        cv::destroyAllWindows();
+        JitterBuffer::Stats stats = buffer.getStats();
+        std::cout << "\nPlayback stopped. Skipped " << stats.skippedFrames << " frames, "
+                  << reconnects.load() << " reconnects." << std::endl;
     }
 };
 
+/**
+ * True for network sources (rtsp://, http://, ...), which play live
+ */
+bool isStreamUrl(const std::string& path) {
+    return path.find("://") != std::string::npos;
+}
+
+/**
+ * Parse a --hw value: none, any, vaapi, d3d11 or mfx
+ */
+bool parseDecodeBackend(const std::string& name, DecodeBackend& backend) {
+    if (name == "none")       backend = DecodeBackend::Software;
+    else if (name == "any")   backend = DecodeBackend::AnyHardware;
+    else if (name == "vaapi") backend = DecodeBackend::VAAPI;
+    else if (name == "d3d11") backend = DecodeBackend::D3D11;
+    else if (name == "mfx")   backend = DecodeBackend::MFX;
+    else return false;
+    return true;
+}
+
+/**
+ * Wildcard match of a file name against 'pattern' ('*' and '?')
+ */
+bool matchesWildcard(const std::string& name, const std::string& pattern) {
+    size_t n = 0;
+    size_t p = 0;
+    size_t starP = std::string::npos; // Last '*' and the name position it matched up to
+    size_t starN = 0;
+    while (n < name.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) {
+            n++;
+            p++;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            starP = p++;
+            starN = n;
+        } else if (starP != std::string::npos) {
+            p = starP + 1;
+            n = ++starN;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') {
+        p++;
+    }
+    return p == pattern.size();
+}
+
+/**
+ * Expand a batch argument: a glob over file names (the directory part is
+ * taken literally, so quote it to keep the shell out) or a plain path
+ */
+std::vector<std::string> expandBatchPattern(const std::string& pattern) {
+    namespace fs = std::filesystem;
+    fs::path path(pattern);
+    std::string namePattern = path.filename().string();
+    if (namePattern.find_first_of("*?") == std::string::npos) {
+        return {pattern};
+    }
+    
+    std::vector<std::string> matches;
+    fs::path directory = path.has_parent_path() ? path.parent_path() : fs::path(".");
+    std::error_code error;
+    for (const fs::directory_entry& entry : fs::directory_iterator(directory, error)) {
+        if (entry.is_regular_file(error) && matchesWildcard(entry.path().filename().string(), namePattern)) {
+            matches.push_back(path.has_parent_path() ? entry.path().string() 
+                                                     : entry.path().filename().string());
+        }
+    }
+    std::sort(matches.begin(), matches.end());
+    if (matches.empty()) {
+        std::cerr << "Warning: No files match " << pattern << std::endl;
+    }
+    return matches;
+}
+
+/**
+ * Read one path per line from 'listFile' ("-" for stdin); blank lines
+ * and lines starting with '#' are skipped
+ */
+bool readFileList(const std::string& listFile, std::vector<std::string>& files) {
+    std::ifstream file;
+    if (listFile != "-") {
+        file.open(listFile);
+        if (!file) {
+            std::cerr << "Cannot read file list " << listFile << std::endl;
+            return false;
+        }
+    }
+    std::istream& in = listFile == "-" ? std::cin : file;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!line.empty() && line[0] != '#') {
+            files.push_back(line);
+        }
+    }
+    return true;
+}
+
+/**
+ * Headless validation of many files: loadVideo() and a full decode of each,
+ * 'jobs' files at a time on a WorkStealingPool. Players load headless and
+ * frame caches are disabled, since nothing is shown or revisited. Writes a JSON summary with per-file decode
+ * fps and errors to 'out' and returns the number of files that failed.
+ */
+int runBatch(std::ostream& out, const std::vector<std::string>& files, size_t jobs, 
+             DecodeBackend decodeBackend, int hwDevice) {
+    using Clock = std::chrono::steady_clock;
+    struct BatchResult {
+        int expectedFrames = 0;
+        int decodedFrames = 0;
+        double decodeSeconds = 0.0;
+        std::string error;
+    };
+    
+    std::vector<BatchResult> results(files.size());
+    auto start = Clock::now();
+    {
+        WorkStealingPool pool(jobs); // Joined at the end of the scope, after every file
+        for (size_t i = 0; i < files.size(); i++) {
+            pool.submit([&, i] {
+                BatchResult& result = results[i];
+                try {
+                    VideoPlayer player;
+                    player.setVerbose(false);
+                    player.setHeadless(true);
+                    player.setDecodeBackend(decodeBackend, hwDevice);
+                    player.setFrameCacheBudget(0);
+                    if (!player.loadVideo(files[i])) {
+                        result.error = "cannot open or decode the first frame";
+                        return;
+                    }
+                    result.expectedFrames = player.getTotalFrames();
+                    auto decodeStart = Clock::now();
+                    result.decodedFrames = 1 + player.decodeToEnd(); // loadVideo() decoded the first
+                    result.decodeSeconds = std::chrono::duration<double>(Clock::now() - decodeStart).count();
+                    if (result.decodedFrames != result.expectedFrames) {
+                        result.error = "decoded " + std::to_string(result.decodedFrames) + " of " +
+                                       std::to_string(result.expectedFrames) + " frames";
+                    }
+                } catch (const std::exception& e) {
+                    result.error = e.what();
+                }
+            });
+        }
+    }
+    double wallSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+    
+    int failed = 0;
+    out << "{\n  \"files\": [";
+    for (size_t i = 0; i < files.size(); i++) {
+        const BatchResult& result = results[i];
+        failed += result.error.empty() ? 0 : 1;
+        out << (i ? ",\n" : "\n")
+            << "    {\"file\": \"" << jsonEscape(files[i]) << "\""
+            << ", \"ok\": " << (result.error.empty() ? "true" : "false")
+            << ", \"frames_expected\": " << result.expectedFrames 
+            << ", \"frames_decoded\": " << result.decodedFrames
+            << ", \"decode_fps\": " << (result.decodeSeconds > 0.0 ? result.decodedFrames / result.decodeSeconds : 0.0);
+        if (!result.error.empty()) {
+            out << ", \"error\": \"" << jsonEscape(result.error) << "\"";
+        }
+        out << "}";
+    }
+    out << "\n  ],\n"
+        << "  \"total\": " << files.size() << ",\n"
+        << "  \"failed\": " << failed << ",\n"
+        << "  \"jobs\": " << jobs << ",\n"
+        << "  \"wall_seconds\": " << wallSeconds << "\n}" << std::endl;
+    return failed;
+}
+
 // Main function - simple usage example
 int main(int argc, char* argv[]) {
+    // Every Mat (decoder output, queues, caches, display) draws from the pool
+    cv::Mat::setDefaultAllocator(&FrameBufferPool::instance());
+    
+    std::vector<std::string> videoFiles;
+    int cacheMegabytes = -1;
+    DecodeBackend decodeBackend = DecodeBackend::Software;
+    int hwDevice = -1;
+    bool openGLDisplay = false;
+    bool fitDisplay = false;
+    bool lowLatency = false;
+    bool mappedInput = false;
+    bool sceneDetection = false;
+    bool audioPlayback = true;
+    bool nativeFrames = false;
+    ToneCurve toneCurve = ToneCurve::Linear;
+    int controlPort = 0;
+    bool benchmark = false;
+    bool batch = false;
+    size_t batchJobs = 0;
+    std::string fileList;
+    int exportFirst = -1;
+    int exportLast = -1;
+    std::string exportOutput;
+    bool compare = false;
+    std::string metricsCsv;
+    
+    // Parse options; the remaining arguments are video file paths
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--cache-mb" && i + 1 < argc) {
+            cacheMegabytes = std::atoi(argv[++i]);
+        } else if (arg == "--hw" && i + 1 < argc) {
+            if (!parseDecodeBackend(argv[++i], decodeBackend)) {
+                std::cerr << "Unknown --hw value (use none, any, vaapi, d3d11 or mfx)" << std::endl;
+                return -1;
+            }
+        } else if (arg == "--hw-device" && i + 1 < argc) {
+            hwDevice = std::atoi(argv[++i]);
+        } else if (arg == "--gl") {
+            openGLDisplay = true;
+        } else if (arg == "--fit") {
+            fitDisplay = true;
+        } else if (arg == "--scenes") {
+            sceneDetection = true;
+        } else if (arg == "--control" && i + 1 < argc) {
+            controlPort = std::atoi(argv[++i]);
+        } else if (arg == "--i420-cache") {
+            nativeFrames = true;
+        } else if (arg == "--tonemap" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name != "linear" && name != "pq") {
+                std::cerr << "Unknown --tonemap value (use linear or pq)" << std::endl;
+                return -1;
+            }
+            toneCurve = name == "pq" ? ToneCurve::PQ : ToneCurve::Linear;
+        } else if (arg == "--no-audio") {
+            audioPlayback = false;
+        } else if (arg == "--mmap") {
+            mappedInput = true;
+        } else if (arg == "--low-latency") {
+            lowLatency = true;
+        } else if (arg == "--compare") {
+            compare = true;
+        } else if (arg == "--metrics-csv" && i + 1 < argc) {
+            metricsCsv = argv[++i];
+        } else if (arg == "--bench") {
+            benchmark = true;
+        } else if (arg == "--batch") {
+            batch = true;
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            batchJobs = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--files-from" && i + 1 < argc) {
+            fileList = argv[++i];
+        } else if (arg == "--export" && i + 2 < argc) {
+            // --export A-B OUT, 1-based inclusive like the on-screen counter
+            if (std::sscanf(argv[++i], "%d-%d", &exportFirst, &exportLast) != 2 || exportFirst < 1) {
+                std::cerr << "Invalid --export range (use A-B)" << std::endl;
+                return -1;
+            }
+            exportOutput = argv[++i];
+        } else {
+            videoFiles.push_back(arg);
+        }
+    }
+    std::string videoFile = videoFiles.empty() ? std::string() : videoFiles.front();
+    
+    // Headless export of a frame range
+    if (!exportOutput.empty()) {
+        if (videoFile.empty()) {
+            std::cerr << "--export needs a video file" << std::endl;
+            return -1;
+        }
+        cv::VideoCapture probe(videoFile);
+        double fps = probe.get(cv::CAP_PROP_FPS);
+        probe.release();
+        bool ok = FrameExporter::exportRange(videoFile, exportFirst - 1, exportLast - 1, 
+                                             exportOutput, fps);
+        return ok ? 0 : -1;
+    }
+    
+    // Headless batch validation: files and globs from the command line
+    // and --files-from, --jobs at a time (default one per hardware thread)
+    if (batch) {
+        std::vector<std::string> batchFiles;
+        for (const std::string& pattern : videoFiles) {
+            std::vector<std::string> matches = expandBatchPattern(pattern);
+            batchFiles.insert(batchFiles.end(), matches.begin(), matches.end());
+        }
+        if (!fileList.empty() && !readFileList(fileList, batchFiles)) {
+            return -1;
+        }
+        if (batchFiles.empty()) {
+            std::cerr << "--batch needs files, globs or --files-from" << std::endl;
+            return -1;
+        }
+        if (batchJobs == 0) {
+            batchJobs = std::max(1u, std::thread::hardware_concurrency());
+        }
+        return runBatch(std::cout, batchFiles, batchJobs, decodeBackend, hwDevice) == 0 ? 0 : 1;
+    }
+    
+    // Headless benchmark: JSON on stdout only, bundled sample by default
+    if (benchmark) {
+        if (videoFile.empty()) {
+            videoFile = "sample.mp4";
+        }
+        VideoPlayer player;
+        player.setVerbose(false);
+        player.setHeadless(true); // No filmstrip or scene decoding competing with the timings
+        player.setDecodeBackend(decodeBackend, hwDevice);
+        player.setNativeFrames(nativeFrames);
+        player.setToneCurve(toneCurve);
+        if (!player.loadVideo(videoFile)) {
+            std::cerr << "Failed to load video: " << videoFile << std::endl;
+            return -1;
+        }
+        player.runBenchmark(std::cout, videoFile);
+        return 0;
+    }
+    
     std::cout << "=== Video Player ===" << std::endl;
     std::cout << "Built with OpenCV \n" << std::endl;
     
-    std::string videoFile;
+    // Network source: live playback through the jitter buffer
+    if (videoFiles.size() == 1 && isStreamUrl(videoFile)) {
+        LiveStreamPlayer livePlayer(videoFile);
+        livePlayer.setLowLatency(lowLatency);
+        livePlayer.startPlayback();
+        return 0;
+    }
+    
+    // Encoder QA: a reference and a rendition in one window, with metrics;
+    // with a CSV requested, every frame is measured headless instead
+    if (compare) {
+        if (videoFiles.size() != 2) {
+            std::cerr << "--compare needs a reference and a rendition file" << std::endl;
+            return -1;
+        }
+        ComparePlayer comparePlayer;
+        for (VideoPlayer* stream : {&comparePlayer.getReference(), &comparePlayer.getRendition()}) {
+            stream->setDecodeBackend(decodeBackend, hwDevice);
+            stream->setMappedInput(mappedInput);
+            stream->setToneCurve(toneCurve);
+            stream->setHeadless(!metricsCsv.empty());
+            if (cacheMegabytes >= 0) {
+                stream->setFrameCacheBudget(static_cast<size_t>(cacheMegabytes) << 20);
+            }
+        }
+        if (!comparePlayer.load(videoFiles[0], videoFiles[1])) {
+            return -1;
+        }
+        if (metricsCsv.empty()) {
+            comparePlayer.startPlayback();
+            return 0;
+        }
+        bool complete = comparePlayer.measureAll();
+        return comparePlayer.writeCsv(metricsCsv) && complete ? 0 : -1;
+    }
+    
+    // Several files: play them side by side in lockstep
+    if (videoFiles.size() > 1) {
+        MultiStreamPlayer multiPlayer;
+        for (const std::string& file : videoFiles) {
+            VideoPlayer& stream = multiPlayer.addStream();
+            stream.setDecodeBackend(decodeBackend, hwDevice);
+            stream.setFitToWindow(fitDisplay);
+            stream.setMappedInput(mappedInput);
+            stream.setSceneDetection(sceneDetection);
+            if (cacheMegabytes >= 0) {
+                stream.setFrameCacheBudget(static_cast<size_t>(cacheMegabytes) << 20);
+            }
+            if (!stream.loadVideo(file)) {
+                std::cerr << "Failed to load video: " << file << std::endl;
+                return -1;
+            }
+        }
+        multiPlayer.startPlayback();
+        return 0;
+    }
     
     // Get video file path
-    if (argc > 1) {
-        videoFile = argv[1];
-    } else {
+    if (videoFile.empty()) {
         std::cout << "Enter video file path: ";
         std::getline(std::cin, videoFile);
     }
     
     // Create and use video player
     VideoPlayer player;
+    player.setDecodeBackend(decodeBackend, hwDevice);
+    player.setOpenGLDisplay(openGLDisplay);
+    player.setFitToWindow(fitDisplay);
+    player.setMappedInput(mappedInput);
+    player.setSceneDetection(sceneDetection);
+    player.setAudioPlayback(audioPlayback);
+    player.setNativeFrames(nativeFrames);
+    player.setToneCurve(toneCurve);
+    player.setControlPort(controlPort);
+    if (cacheMegabytes >= 0) {
+        player.setFrameCacheBudget(static_cast<size_t>(cacheMegabytes) << 20);
+    }
     
-    if (player.loadVideo(videoFile)) {
-        player.startPlayback();
-    } else {
+    // Opens in the background: the window is up before the file is
+    player.loadVideoAsync(videoFile);
+    player.startPlayback();
+    if (player.isOpenAbandoned()) {
+        return 0;
+    }
+    if (!player.isLoaded()) {
         std::cerr << "Failed to load video: " << videoFile << std::endl;
         return -1;
     }